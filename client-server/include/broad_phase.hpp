@@ -0,0 +1,60 @@
+#pragma once
+#include "aabb_tree.hpp"
+#include "body_store.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Uniform grid hashed into a table sized to the body count. Cells are as
+// wide as the largest body, so touching bodies are always in the same or
+// in neighboring cells. Rebuilt every tick with a counting sort into
+// buffers that are reused between ticks.
+class SpatialHashGrid {
+private:
+  float cellSize = 1.0f;
+  uint32_t mask = 0;
+  std::vector<int64_t> cellX, cellY;
+  std::vector<uint32_t> bodyBucket;
+  std::vector<uint32_t> bucketStart; // bucket b holds [start[b], start[b+1])
+  std::vector<uint32_t> bucketBodies;
+
+  uint32_t bucketFor(int64_t cx, int64_t cy) const;
+
+public:
+  void build(const BodyStore &bodies);
+
+  // Appends every pair whose bounding boxes overlap.
+  void findPairs(const BodyStore &bodies, std::vector<BodyPair> &pairs) const;
+};
+
+// Sweep and prune on the x-axis. The sorted endpoint list is kept between
+// ticks and re-sorted with insertion sort, which is close to linear when
+// bodies move little per step. Unlike the grid it does not care about the
+// spread of radii.
+class SweepAndPrune {
+private:
+  struct Endpoint {
+    float value;
+    uint32_t body;
+    bool isMin;
+  };
+
+  std::vector<Endpoint> endpoints;
+  std::vector<uint32_t> active;
+  std::vector<uint32_t> activeSlot;
+
+  static bool less(const Endpoint &a, const Endpoint &b);
+
+public:
+  // Refreshes the endpoints from the bodies and restores the order.
+  void update(const BodyStore &bodies);
+
+  // Appends every pair whose bounding boxes overlap.
+  void findPairs(const BodyStore &bodies, std::vector<BodyPair> &pairs);
+};
+
+// Broad phase over the engine's dynamic AABB tree. Bodies are only
+// reinserted when they leave their fat boxes; fat-box pairs are then
+// filtered down to overlapping tight boxes in place.
+void findTreePairs(BodyTree &tree, const BodyStore &bodies,
+                   std::vector<BodyPair> &pairs);
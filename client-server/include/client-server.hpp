@@ -1,30 +1,73 @@
 #pragma once
-#include "engine.hpp"
-#include <SFML/System/Vector2.hpp>
-#include <X11/X.h>
+#include "aabb_tree.hpp"
+#include "body_store.hpp"
+#include "interpolation.hpp"
+#include "physics.hpp"
+#include "snapshot.hpp"
+#include "tick_scheduler.hpp"
+#include "triple_buffer.hpp"
 #include <arpa/inet.h>
 #include <atomic>
 #include <cstdint>
 #include <fcntl.h>
-#include <imgui-SFML.h>
-#include <imgui.h>
 #include <mutex>
 #include <netinet/in.h>
 #include <string>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <vector>
 
 extern std::atomic<bool> clientRunning;
 
+struct ServerSettings {
+  int tickRate = 100;
+  int substeps = 1;          // physics steps per tick
+  int sendInterval = 1;      // ticks per broadcast
+  int offscreenInterval = 8; // sends per update of bodies a client can't see
+  OverrunPolicy overrunPolicy = OverrunPolicy::Skip;
+  WireFormat wire;
+};
+
 uint32_t float_to_network(float value);
 
 float network_to_float(uint32_t value);
 
-void server_send_broadcast(int sockfd, std::vector<Planet> *planets,
-                           std::mutex *planets_mutex, int port,
-                           const std::string &ip, float *G, float *timeStep);
+// Bodies as of the end of a tick, published for the render thread and the
+// send stage.
+struct PublishedState {
+  BodyStore bodies; // no acceleration or integration buffers
+  uint64_t tick = 0;
+  int64_t time = 0;       // tick deadline in microseconds, CLOCK_MONOTONIC
+  float timeScale = 0.0f; // simulated seconds per second
+};
+
+// Bodies the UI wants added. The simulation takes them at the start of a
+// tick when the lock is free and gives them fresh ids.
+struct BodyRequests {
+  std::mutex mutex;
+  BodyStore bodies;
+};
+
+// Runs the simulation on `bodies`, which only this thread may touch, while a
+// second thread encodes and sends the snapshots of earlier ticks. Other
+// threads see the state through `published` and change it through
+// `requests`; either may be null.
+void server_send_broadcast(int sockfd, BodyStore *bodies,
+                           TripleBuffer<PublishedState> *published,
+                           BodyRequests *requests, int port,
+                           const std::string &ip, PhysicsSettings *physics,
+                           ServerSettings *server, TickStats *tick_stats);
+
+// World region the client's camera shows, written by the render loop and
+// reported to the server with every ack.
+struct ClientView {
+  std::mutex mutex;
+  AABB region = {0.0f, 0.0f, 0.0f, 0.0f};
+  bool known = false;
+};
 
-void client_receive(int sockfd, std::vector<Planet> *planets,
-                    std::mutex *planets_mutex,
-                    std::vector<std::vector<sf::Vertex>> *trajectories);
+// Reassembles and acks snapshots and hands them to the interpolation buffer
+// the render loop samples.
+void client_receive(int sockfd, InterpolationBuffer *interpolation,
+                    ClientView *view);
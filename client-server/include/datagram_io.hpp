@@ -0,0 +1,55 @@
+#pragma once
+#include "snapshot.hpp"
+#include <cstddef>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
+
+// Sends many datagrams per sendmmsg call on Linux and one sendto each
+// elsewhere. The message headers are reused between calls.
+class DatagramSender {
+private:
+#ifdef __linux__
+  std::vector<mmsghdr> headers;
+  std::vector<iovec> vectors;
+#endif
+
+public:
+  static constexpr size_t BATCH_SIZE = 64;
+
+  DatagramSender();
+
+  // Sends every fragment of the encoder to `addr`.
+  void send(int sockfd, const SnapshotEncoder &encoder,
+            const sockaddr_in &addr);
+};
+
+// Receives up to BATCH_SIZE datagrams per recvmmsg call on Linux, one per
+// recvfrom elsewhere, into buffers kept between calls.
+class DatagramReceiver {
+private:
+  std::vector<char> buffers;
+  std::vector<size_t> sizes;
+  std::vector<sockaddr_in> senders;
+#ifdef __linux__
+  std::vector<mmsghdr> headers;
+  std::vector<iovec> vectors;
+#endif
+
+public:
+  static constexpr size_t BATCH_SIZE = 64;
+  // longer datagrams come back empty; fragments are at most FRAGMENT_SIZE
+  static constexpr size_t DATAGRAM_SIZE = 2048;
+
+  DatagramReceiver();
+
+  // Waits for one datagram, up to the socket's receive timeout, unless
+  // `wait` is false, then takes every queued one up to BATCH_SIZE. Returns
+  // how many were received, 0 when none were queued, or -1 on errors.
+  int receive(int sockfd, bool wait);
+
+  const char *data(size_t index) const;
+  size_t size(size_t index) const;
+  const sockaddr_in &sender(size_t index) const;
+};
@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+
+enum class GravityKernel { Auto, Scalar, Avx2, Avx512 };
+
+// Best kernel this CPU supports, detected once through CPUID
+GravityKernel detectGravityKernel();
+bool gravityKernelSupported(GravityKernel kernel);
+const char *gravityKernelName(GravityKernel kernel);
+
+// Direct-sum accelerations of targets [begin, end) from all `count` sources,
+// written to ax/ay. Sources closer than 1 unit are ignored, as in the
+// original loop. Each target's result does not depend on begin/end, so the
+// range may be split freely between threads.
+void computeGravity(GravityKernel kernel, const float *x, const float *y,
+                    const float *mass, size_t count, float G, size_t begin,
+                    size_t end, float *ax, float *ay);
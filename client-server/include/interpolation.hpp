@@ -0,0 +1,77 @@
+#pragma once
+#include "body_store.hpp"
+#include "snapshot.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+enum class SampleState { Empty, Interpolating, Extrapolating };
+
+// Jitter buffer of the last snapshots a client received. Bodies are shown
+// as they were `delay` before the server time that corresponds to now,
+// interpolated between the two snapshots around that time, or moved along
+// their velocities once the buffer runs dry.
+class InterpolationBuffer {
+private:
+  std::mutex mutex;
+  std::vector<Snapshot> slots;
+  size_t newest = 0;
+  size_t count = 0;
+  // filled by push() outside the lock and swapped with the oldest slot, so
+  // it ends up holding that slot's buffers for the next push
+  Snapshot incoming;
+
+  // local clock minus server clock, in microseconds; tracks the fastest
+  // delivery seen, so late packets do not pull the render time back
+  int64_t clockOffset = 0;
+  int64_t lastArrival = 0;
+
+  const Snapshot &at(size_t age) const;
+
+public:
+  static constexpr size_t BUFFER_SIZE = 32;
+  // bodies stop moving this long after the newest snapshot
+  static constexpr int64_t MAX_EXTRAPOLATION = 250000;
+
+  InterpolationBuffer();
+
+  // Keeps a copy of the snapshot, allocating only while body counts grow.
+  // Snapshots must be pushed in sequence order from one thread; one older
+  // than the newest means the server restarted.
+  void push(const Snapshot &snapshot,
+            std::chrono::steady_clock::time_point arrival);
+
+  // Writes the bodies as of `delay` ago, leaving them untouched while the
+  // buffer is empty.
+  SampleState sample(std::chrono::steady_clock::time_point now,
+                     std::chrono::microseconds delay, BodyStore &bodies);
+};
+
+// The last two states a simulation in the same process published, blended
+// by the tick alpha: how far the time since the newer one arrived is into
+// the tick that separates them. Bodies are shown one tick late but move at
+// the display rate whatever the tick rate, and stop at the newer state when
+// the next one is late.
+class TickInterpolator {
+private:
+  BodyStore previous, current;
+  int64_t previousTime = 0, currentTime = 0; // tick times in microseconds
+  std::chrono::steady_clock::time_point arrival;
+  size_t count = 0;
+
+public:
+  // Keeps a copy of a newly published state, allocating only while body
+  // counts grow. `time` is its tick time.
+  void push(const BodyStore &bodies, int64_t time,
+            std::chrono::steady_clock::time_point arrival);
+
+  // Writes the bodies as of `now` and returns the tick alpha, 0 at the older
+  // state and 1 at the newer one. Leaves them untouched before the first
+  // push.
+  float sample(std::chrono::steady_clock::time_point now,
+               BodyStore &bodies) const;
+};
+
+const char *sampleStateName(SampleState state);
@@ -1,16 +1,43 @@
 #pragma once
-#include "engine.hpp"
-#include <SFML/System/Vector2.hpp>
-#include <X11/X.h>
-#include <arpa/inet.h>
-#include <fcntl.h>
-#include <imgui-SFML.h>
-#include <imgui.h>
-#include <netinet/in.h>
-#include <sys/socket.h>
-#include <sys/types.h>
-#include <unistd.h>
+#include "body_store.hpp"
+#include "broad_phase.hpp"
+#include "gravity_kernels.hpp"
+#include "thread_pool.hpp"
 #include <vector>
 
-void applyGravity(std::vector<Planet> &planets, float G, float timeStep);
-void applyCollision(std::vector<Planet> &planets);
+enum class CollisionBackend {
+  BruteForce,
+  SpatialHash,
+  SweepAndPrune,
+  BoundingVolumeTree
+};
+
+struct PhysicsSettings {
+  float G = 100.0f;
+  float timeStep = 0.016f;
+  // Barnes-Hut opening angle, 0 falls back to direct summation
+  float theta = 0.5f;
+  // below this many bodies the SIMD direct sum beats the quadtree
+  int barnesHutThreshold = 8192;
+  GravityKernel kernel = GravityKernel::Auto;
+  // workers for the force loop, the simulation thread is one of them
+  int threads = 1;
+  CollisionBackend collision = CollisionBackend::SpatialHash;
+};
+
+// broad-phase buffers kept between ticks
+struct CollisionState {
+  SpatialHashGrid grid;
+  SweepAndPrune sweep;
+  BodyTree tree;
+  std::vector<BodyPair> pairs;
+};
+
+// Splits the force loop over the targets between the pool's workers. The
+// result does not depend on the number of workers.
+void applyGravity(BodyStore &bodies, const PhysicsSettings &settings,
+                  ThreadPool &pool);
+void applyCollision(BodyStore &bodies, const PhysicsSettings &settings,
+                    CollisionState &state);
+
+const char *collisionBackendName(CollisionBackend backend);
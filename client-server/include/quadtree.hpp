@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Barnes-Hut quadtree over point masses. Nodes are kept in one flat array
+// that is reused between builds, so rebuilding every tick does not allocate
+// once the tree has reached its working size.
+class QuadTree {
+private:
+  struct Node {
+    float centerX, centerY, halfSize;
+    float mass, massX, massY; // total mass and center of mass
+    int32_t firstChild;       // index of 4 consecutive children, -1 for a leaf
+    int32_t body;             // first body of a leaf, -1 otherwise
+    int32_t count;            // bodies below this node
+  };
+
+  std::vector<Node> nodes;
+  // next body in the same leaf, -1 at the end; only leaves at MAX_DEPTH
+  // hold more than one
+  std::vector<int32_t> next;
+  const float *x = nullptr;
+  const float *y = nullptr;
+  const float *m = nullptr;
+
+  int32_t makeNode(float centerX, float centerY, float halfSize);
+  int32_t childFor(int32_t node, float px, float py) const;
+  void addMass(int32_t node, int32_t body);
+  void insert(int32_t body);
+
+public:
+  static const int MAX_DEPTH = 24;
+
+  void build(const float *x, const float *y, const float *mass, size_t count);
+
+  // Acceleration on body `target` with opening angle `theta`: a node is
+  // treated as a single mass when size / distance < theta and its box does
+  // not contain the target.
+  void accelerationAt(size_t target, float G, float theta, float &ax,
+                      float &ay) const;
+};
@@ -0,0 +1,7 @@
+#pragma once
+#include "body_store.hpp"
+#include <string>
+
+// Appends the planets of a JSON scene file (see assets/planets.json) to
+// `bodies`. Returns false when the file cannot be opened.
+bool loadScene(const std::string &path, BodyStore &bodies);
@@ -0,0 +1,149 @@
+#pragma once
+#include "aabb_tree.hpp"
+#include "body_store.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum PacketType : uint8_t { PACKET_SNAPSHOT = 1, PACKET_ACK = 2 };
+
+struct FieldEncoding;
+
+// Precision of positions and velocities on the wire. 0 sends 32-bit floats,
+// otherwise fixed-point codes over ranges carried in the packet header.
+struct WireFormat {
+  int positionBits = 0; // 16 or 24, relative to the bodies' bounding box
+  int velocityBits = 0; // 8, 16 or 24
+};
+
+// Ranges the fixed-point codes span. Kept from snapshot to snapshot while
+// the bodies stay inside, so bodies that do not move keep their codes.
+struct QuantizationFrame {
+  float originX = 0.0f, sizeX = 0.0f;
+  float originY = 0.0f, sizeY = 0.0f;
+  float originV = 0.0f, sizeV = 0.0f;
+};
+
+// Body state sent under one sequence number, ordered by body id.
+struct Snapshot {
+  uint32_t sequence = 0; // 0 marks an empty or invalid snapshot
+  uint64_t time = 0;      // server steady clock at capture, microseconds
+  float timeScale = 0.0f; // simulated seconds per second on the server
+  std::vector<uint32_t> id;
+  std::vector<float> x, y;
+  std::vector<float> vx, vy;
+  std::vector<float> mass;
+  std::vector<float> radius;
+  std::vector<BodyColor> color;
+
+  // filled by quantize() on the server only
+  WireFormat format;
+  QuantizationFrame frame;
+  std::vector<uint32_t> codeX, codeY;
+  std::vector<uint32_t> codeVx, codeVy;
+
+  size_t size() const;
+  void resize(size_t count);
+
+  // Copies the first `count` bodies.
+  void capture(const BodyStore &bodies, size_t count, uint32_t sequence);
+  void apply(BodyStore &bodies) const;
+
+  // Copies `current`, except that bodies whose `fresh` flag is 0 keep their
+  // values from `baseline`, so a delta against it leaves them out.
+  void captureFresh(const Snapshot &current, const Snapshot &baseline,
+                    const std::vector<uint8_t> &fresh);
+
+  // Replaces x, y, vx, vy with the values the client will decode and keeps
+  // their codes for the encoder. The frame is refitted when needed.
+  void quantize(const WireFormat &format, QuantizationFrame &frame);
+};
+
+// The last HISTORY_SIZE snapshots by sequence number, kept as baselines for
+// delta encoding on the server and delta decoding on the client.
+class SnapshotHistory {
+private:
+  std::vector<Snapshot> slots;
+
+public:
+  static constexpr uint32_t HISTORY_SIZE = 32;
+
+  SnapshotHistory();
+
+  // Slot that will hold `sequence`, evicting the snapshot sent
+  // HISTORY_SIZE sequences earlier.
+  Snapshot &slot(uint32_t sequence);
+  const Snapshot *find(uint32_t sequence) const;
+};
+
+// True when a was sent after b, allowing for wrap-around.
+bool sequenceNewer(uint32_t a, uint32_t b);
+
+// Leading fields of every snapshot fragment. A fragment carries the bodies
+// with ids in [firstId, endId); the fragments of one snapshot cover all ids
+// in index order, the last one ending at UINT32_MAX.
+struct FragmentHeader {
+  uint32_t sequence;
+  uint32_t baseline; // 0 for a keyframe
+  uint16_t index;
+  uint16_t count;
+  uint32_t firstId;
+  uint32_t endId;
+  uint64_t time;
+  float timeScale;
+};
+
+bool readFragmentHeader(const char *data, size_t size, FragmentHeader &header);
+
+// Splits a snapshot into datagrams of at most FRAGMENT_SIZE bytes. Each
+// fragment holds the ids removed since the baseline and the changed fields
+// of every body that differs, for its own id range, plus a palette of the
+// colors it uses, so it decodes without the others. A null baseline writes
+// a keyframe with every field. Buffers are reused between calls.
+class SnapshotEncoder {
+private:
+  std::vector<std::vector<char>> fragments;
+  size_t fragmentCount = 0;
+
+  std::vector<uint32_t> removed;
+  std::vector<char> entries;
+  uint32_t changed = 0;
+  uint32_t bodyCount = 0;
+  uint32_t firstId = 0;
+  uint32_t previousId = 0;
+
+  void begin(uint32_t firstId, FieldEncoding &encoding);
+  bool fits(size_t bytes, const FieldEncoding &encoding) const;
+  void finish(uint32_t endId, const Snapshot &current,
+              const Snapshot *baseline, const FieldEncoding &encoding);
+
+public:
+  static constexpr size_t FRAGMENT_SIZE = 1400;
+
+  void encode(const Snapshot &current, const Snapshot *baseline);
+
+  size_t size() const;
+  const std::vector<char> &fragment(size_t index) const;
+};
+
+// Decodes one fragment on top of the baseline's bodies in the fragment's id
+// range and appends the result to `out`. The baseline must be the one the
+// fragment names, or null for a keyframe. Returns false for malformed
+// fragments, leaving `out` partly written.
+bool decodeFragment(const char *data, size_t size, const Snapshot *baseline,
+                    Snapshot &out);
+
+// Sent by a client for every complete snapshot. The view is the world
+// region it shows, margin included; bodies outside it are sent less often.
+struct Ack {
+  uint32_t sequence = 0;
+  bool hasView = false;
+  AABB view = {0.0f, 0.0f, 0.0f, 0.0f};
+};
+
+const size_t ACK_SIZE = 5;
+const size_t MAX_ACK_SIZE = ACK_SIZE + 4 * sizeof(float);
+
+// Returns the number of bytes written, at most MAX_ACK_SIZE.
+size_t encodeAck(const Ack &ack, char *buffer);
+bool decodeAck(const char *data, size_t size, Ack &ack);
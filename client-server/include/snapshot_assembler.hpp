@@ -0,0 +1,43 @@
+#pragma once
+#include "snapshot.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Collects snapshot fragments on the client. A snapshot is decoded once all
+// of its fragments are in and then kept as a baseline for later deltas;
+// snapshots still incomplete after a timeout are applied for the id ranges
+// that did arrive and dropped.
+class SnapshotAssembler {
+private:
+  struct Pending {
+    uint32_t sequence = 0; // 0 marks a free slot
+    uint32_t baseline = 0;
+    uint16_t count = 0;
+    uint16_t received = 0;
+    std::vector<std::vector<char>> fragments; // the first `count` are used
+    std::vector<bool> arrived;
+    std::chrono::steady_clock::time_point started;
+  };
+
+  std::vector<Pending> pending;
+  SnapshotHistory history;
+  Snapshot piece;
+
+  const Snapshot *complete(Pending &snapshot);
+
+public:
+  static constexpr size_t MAX_PENDING = 8;
+
+  SnapshotAssembler();
+
+  // Stores a fragment and returns the snapshot it completes, or null.
+  const Snapshot *add(const char *data, size_t size);
+
+  // Splices the fragments that arrived of incomplete snapshots newer than
+  // `state` into it once they are older than `timeout`, and drops them.
+  // Returns true when `state` changed.
+  bool flushExpired(std::chrono::steady_clock::duration timeout,
+                    Snapshot &state);
+};
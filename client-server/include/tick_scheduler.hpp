@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <time.h>
+
+enum class OverrunPolicy {
+  CatchUp, // run the missed ticks back to back, up to MAX_CATCH_UP
+  Skip     // drop the missed ticks and continue on the next deadline
+};
+
+struct TickStats {
+  std::atomic<uint64_t> ticks{0};
+  std::atomic<uint64_t> overruns{0};     // waits that found deadlines missed
+  std::atomic<uint64_t> skippedTicks{0}; // ticks dropped by the policy
+
+  // moving averages per run of each server stage, in milliseconds
+  std::atomic<float> physicsMs{0.0f}; // added bodies and integration
+  std::atomic<float> publishMs{0.0f}; // copies for the renderer and sender
+  std::atomic<float> sendMs{0.0f};    // acks, capture, encoding and sending
+  // states simulated for sending but replaced before the send stage woke
+  std::atomic<uint64_t> droppedSends{0};
+};
+
+// Fixed-rate scheduler on absolute CLOCK_MONOTONIC deadlines. Uses a
+// periodic timerfd where available and clock_nanosleep otherwise, so the
+// period never stretches by the time spent in a tick.
+class TickScheduler {
+private:
+  int timerfd = -1;
+  int tickRate = 0;
+  int64_t periodNs = 0;
+  timespec deadline; // the next deadline not yet waited for
+  OverrunPolicy policy;
+  TickStats *stats;
+
+  void arm();
+  uint64_t waitTimerfd();
+  uint64_t waitNanosleep();
+
+public:
+  static constexpr uint64_t MAX_CATCH_UP = 8;
+
+  TickScheduler(int tickRate, OverrunPolicy policy, TickStats *stats);
+  ~TickScheduler();
+
+  TickScheduler(const TickScheduler &) = delete;
+  TickScheduler &operator=(const TickScheduler &) = delete;
+
+  // Restarts the schedule from now if the rate changed.
+  void setTickRate(int newTickRate);
+  void setPolicy(OverrunPolicy newPolicy);
+
+  // Blocks until the next deadline and returns how many ticks to run.
+  uint64_t wait();
+
+  // CLOCK_MONOTONIC time in nanoseconds of the deadline the last wait()
+  // returned for. Evenly spaced, unlike the time the tick actually ran.
+  int64_t tickTime() const;
+};
+
+const char *overrunPolicyName(OverrunPolicy policy);
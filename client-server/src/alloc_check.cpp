@@ -0,0 +1,141 @@
+#include "body_store.hpp"
+#include "client-server.hpp"
+#include "interpolation.hpp"
+#include "physics.hpp"
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <new>
+#include <random>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <thread>
+#include <unistd.h>
+
+// Checks that the client's receive path stops allocating once it has seen
+// a few snapshots: a server and a client run in this process over
+// loopback, and every operator new on the receive thread is counted.
+// Exits with 1 on any allocation during the measured window.
+
+static std::atomic<long> allocations(0);
+static thread_local bool counting = false;
+
+void *operator new(size_t size) {
+  if (counting) {
+    allocations++;
+  }
+  void *memory = std::malloc(size ? size : 1);
+  if (!memory)
+    throw std::bad_alloc();
+  return memory;
+}
+
+void operator delete(void *memory) noexcept { std::free(memory); }
+void operator delete(void *memory, size_t) noexcept { std::free(memory); }
+
+// bodies spread far enough apart that few of them merge
+static void makeScene(BodyStore &bodies, size_t count) {
+  std::mt19937 random(1);
+  std::uniform_real_distribution<float> position(0.0f, 4000.0f);
+  std::uniform_real_distribution<float> velocity(-20.0f, 20.0f);
+  for (size_t k = 0; k < count; k++) {
+    size_t i = bodies.add(2.0f, 10.0f);
+    bodies.x[i] = position(random);
+    bodies.y[i] = position(random);
+    bodies.vx[i] = velocity(random);
+    bodies.vy[i] = velocity(random);
+  }
+}
+
+int main(int argc, char **argv) {
+  size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000;
+  int warmSeconds = argc > 2 ? std::atoi(argv[2]) : 3;
+  int measureSeconds = argc > 3 ? std::atoi(argv[3]) : 3;
+
+  int client_sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  int server_sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (client_sockfd < 0 || server_sockfd < 0) {
+    perror("socket creation failed");
+    return 1;
+  }
+
+  // any free port; the server sends to it over loopback
+  sockaddr_in client_addr;
+  memset(&client_addr, 0, sizeof(client_addr));
+  client_addr.sin_family = AF_INET;
+  client_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(client_addr);
+  if (bind(client_sockfd, (const sockaddr *)&client_addr,
+           sizeof(client_addr)) < 0 ||
+      getsockname(client_sockfd, (sockaddr *)&client_addr, &length) < 0) {
+    perror("client bind failed");
+    return 1;
+  }
+  struct timeval tv;
+  tv.tv_sec = 1;
+  tv.tv_usec = 0;
+  setsockopt(client_sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  BodyStore bodies;
+  makeScene(bodies, count);
+  PhysicsSettings physics;
+  physics.G = 10.0f;
+  ServerSettings server;
+  TickStats tickStats;
+  std::thread server_thread(server_send_broadcast, server_sockfd, &bodies,
+                            nullptr, nullptr, ntohs(client_addr.sin_port),
+                            std::string("127.0.0.1"), &physics, &server,
+                            &tickStats);
+
+  // a view over part of the scene, so off-screen updates are exercised too
+  ClientView view;
+  view.region = {0.0f, 0.0f, 2000.0f, 2000.0f};
+  view.known = true;
+  InterpolationBuffer interpolation;
+  std::thread client_thread([&] {
+    counting = true;
+    client_receive(client_sockfd, &interpolation, &view);
+  });
+
+  std::this_thread::sleep_for(std::chrono::seconds(warmSeconds));
+  BodyStore before, after;
+  auto now = std::chrono::steady_clock::now();
+  interpolation.sample(now, std::chrono::microseconds(0), before);
+  long warmAllocations = allocations.exchange(0);
+
+  std::this_thread::sleep_for(std::chrono::seconds(measureSeconds));
+  long steadyAllocations = allocations;
+  now = std::chrono::steady_clock::now();
+  interpolation.sample(now, std::chrono::microseconds(0), after);
+
+  clientRunning = false;
+  client_thread.join();
+  server_thread.join();
+  close(client_sockfd);
+  close(server_sockfd);
+
+  // snapshots must have kept arriving, or the count proves nothing
+  bool received = !after.empty() &&
+                  (after.size() != before.size() ||
+                   std::memcmp(after.x.data(), before.x.data(),
+                               after.size() * sizeof(float)) != 0);
+
+  std::cout << tickStats.ticks << " ticks; receive thread allocated "
+            << warmAllocations << " times while warming up, "
+            << steadyAllocations << " times in " << measureSeconds
+            << " s of steady state" << std::endl;
+  if (!received) {
+    std::cout << "FAIL: no snapshots arrived while measuring" << std::endl;
+    return 1;
+  }
+  if (steadyAllocations != 0) {
+    std::cout << "FAIL: the receive path allocates" << std::endl;
+    return 1;
+  }
+  std::cout << "OK" << std::endl;
+  return 0;
+}
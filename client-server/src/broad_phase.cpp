@@ -0,0 +1,199 @@
+#include "broad_phase.hpp"
+#include "aabb_tree.hpp"
+#include "body_store.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+static bool boxesOverlap(const BodyStore &bodies, uint32_t a, uint32_t b) {
+  float reach = bodies.radius[a] + bodies.radius[b];
+  return std::abs(bodies.x[a] - bodies.x[b]) < reach &&
+         std::abs(bodies.y[a] - bodies.y[b]) < reach;
+}
+
+// cell coordinate of a position; far-out cells are clamped to +-2^62, so
+// the conversion is defined and neighbour offsets cannot overflow
+static int64_t cellOf(float position, float cellSize) {
+  const float limit = 4.611686e18f; // 2^62
+  float cell = std::floor(position / cellSize);
+  if (!std::isfinite(cell))
+    return 0;
+  return static_cast<int64_t>(std::min(std::max(cell, -limit), limit));
+}
+
+uint32_t SpatialHashGrid::bucketFor(int64_t cx, int64_t cy) const {
+  uint64_t hash = static_cast<uint64_t>(cx) * 73856093u ^
+                  static_cast<uint64_t>(cy) * 19349663u;
+  return static_cast<uint32_t>(hash) & mask;
+}
+
+void SpatialHashGrid::build(const BodyStore &bodies) {
+  size_t count = bodies.size();
+
+  float maxRadius = 0.0f;
+  for (size_t i = 0; i < count; i++) {
+    maxRadius = std::max(maxRadius, bodies.radius[i]);
+  }
+  cellSize = std::max(1.0f, 2.0f * maxRadius);
+
+  uint32_t tableSize = 16;
+  while (tableSize < 2 * count) {
+    tableSize *= 2;
+  }
+  mask = tableSize - 1;
+
+  cellX.resize(count);
+  cellY.resize(count);
+  bodyBucket.resize(count);
+  bucketStart.assign(tableSize + 1, 0);
+  bucketBodies.resize(count);
+
+  for (size_t i = 0; i < count; i++) {
+    cellX[i] = cellOf(bodies.x[i], cellSize);
+    cellY[i] = cellOf(bodies.y[i], cellSize);
+
+    bodyBucket[i] = bucketFor(cellX[i], cellY[i]);
+    bucketStart[bodyBucket[i] + 1]++;
+  }
+
+  for (uint32_t b = 0; b < tableSize; b++) {
+    bucketStart[b + 1] += bucketStart[b];
+  }
+
+  // second pass of the counting sort; bodies stay in index order per bucket
+  for (size_t i = 0; i < count; i++) {
+    bucketBodies[bucketStart[bodyBucket[i]]++] = static_cast<uint32_t>(i);
+  }
+
+  // filling advanced every start to the next bucket's start
+  for (uint32_t b = tableSize; b > 0; b--) {
+    bucketStart[b] = bucketStart[b - 1];
+  }
+  bucketStart[0] = 0;
+}
+
+void SpatialHashGrid::findPairs(const BodyStore &bodies,
+                                std::vector<BodyPair> &pairs) const {
+  size_t count = bodyBucket.size();
+
+  for (size_t i = 0; i < count; i++) {
+    // distinct buckets of the 3x3 neighborhood, hashing may merge some
+    uint32_t buckets[9];
+    int bucketCount = 0;
+    for (int64_t dy = -1; dy <= 1; dy++) {
+      for (int64_t dx = -1; dx <= 1; dx++) {
+        uint32_t bucket = bucketFor(cellX[i] + dx, cellY[i] + dy);
+        if (std::find(buckets, buckets + bucketCount, bucket) ==
+            buckets + bucketCount) {
+          buckets[bucketCount++] = bucket;
+        }
+      }
+    }
+
+    for (int k = 0; k < bucketCount; k++) {
+      for (uint32_t slot = bucketStart[buckets[k]];
+           slot < bucketStart[buckets[k] + 1]; slot++) {
+        uint32_t j = bucketBodies[slot];
+        if (j <= i)
+          continue;
+
+        if (boxesOverlap(bodies, static_cast<uint32_t>(i), j)) {
+          pairs.push_back({static_cast<uint32_t>(i), j});
+        }
+      }
+    }
+  }
+}
+
+// starts sort before ends at the same x, so a zero-width box opens before
+// it closes; boxes that only touch are rejected by boxesOverlap
+bool SweepAndPrune::less(const Endpoint &a, const Endpoint &b) {
+  if (a.value != b.value)
+    return a.value < b.value;
+  return a.isMin && !b.isMin;
+}
+
+void SweepAndPrune::update(const BodyStore &bodies) {
+  size_t count = bodies.size();
+  bool rebuilt = false;
+
+  if (endpoints.size() != 2 * count) {
+    rebuilt = true;
+    endpoints.clear();
+    for (size_t i = 0; i < count; i++) {
+      endpoints.push_back({0.0f, static_cast<uint32_t>(i), true});
+      endpoints.push_back({0.0f, static_cast<uint32_t>(i), false});
+    }
+  }
+
+  for (auto &endpoint : endpoints) {
+    // like bodyBounds, non-finite bodies get an empty box at the origin;
+    // a negative radius counts as 0, so no end sorts before its start
+    float x = bodies.x[endpoint.body];
+    float radius = std::max(0.0f, bodies.radius[endpoint.body]);
+    if (!std::isfinite(x) || !std::isfinite(radius)) {
+      x = 0.0f;
+      radius = 0.0f;
+    }
+    endpoint.value = endpoint.isMin ? x - radius : x + radius;
+  }
+
+  if (rebuilt) {
+    std::sort(endpoints.begin(), endpoints.end(), less);
+    return;
+  }
+
+  // insertion sort, near O(n) on the almost sorted list of the last tick
+  for (size_t i = 1; i < endpoints.size(); i++) {
+    Endpoint endpoint = endpoints[i];
+    size_t j = i;
+    while (j > 0 && less(endpoint, endpoints[j - 1])) {
+      endpoints[j] = endpoints[j - 1];
+      j--;
+    }
+    endpoints[j] = endpoint;
+  }
+}
+
+void SweepAndPrune::findPairs(const BodyStore &bodies,
+                              std::vector<BodyPair> &pairs) {
+  active.clear();
+  activeSlot.resize(bodies.size());
+
+  for (const auto &endpoint : endpoints) {
+    uint32_t body = endpoint.body;
+
+    if (!endpoint.isMin) {
+      // swap-remove from the open intervals
+      uint32_t slot = activeSlot[body];
+      active[slot] = active.back();
+      activeSlot[active[slot]] = slot;
+      active.pop_back();
+      continue;
+    }
+
+    for (uint32_t other : active) {
+      if (boxesOverlap(bodies, body, other)) {
+        pairs.push_back({std::min(body, other), std::max(body, other)});
+      }
+    }
+
+    activeSlot[body] = static_cast<uint32_t>(active.size());
+    active.push_back(body);
+  }
+}
+
+void findTreePairs(BodyTree &tree, const BodyStore &bodies,
+                   std::vector<BodyPair> &pairs) {
+  tree.update(bodies);
+
+  size_t first = pairs.size();
+  tree.findOverlaps(pairs);
+
+  auto tight = std::remove_if(
+      pairs.begin() + first, pairs.end(), [&](const BodyPair &pair) {
+        return !boxesOverlap(bodies, pair.a, pair.b);
+      });
+  pairs.erase(tight, pairs.end());
+}
@@ -1,6 +1,18 @@
 #include "client-server.hpp"
-#include "engine.hpp"
+#include "aabb_tree.hpp"
+#include "body_store.hpp"
+#include "datagram_io.hpp"
+#include "interpolation.hpp"
 #include "physics.hpp"
+#include "snapshot.hpp"
+#include "snapshot_assembler.hpp"
+#include "thread_pool.hpp"
+#include "tick_scheduler.hpp"
+#include "triple_buffer.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <cstring>
 #include <fcntl.h>
@@ -29,204 +41,387 @@ float network_to_float(uint32_t value) {
   return result;
 }
 
-void server_send_broadcast(int sockfd, std::vector<Planet> *planets,
-                           std::mutex *planets_mutex, int port,
-                           const std::string &ip, float *G, float *timeStep) {
-  struct sockaddr_in broadcast_addr;
-  memset(&broadcast_addr, 0, sizeof(broadcast_addr));
-
-  broadcast_addr.sin_family = AF_INET;
-  broadcast_addr.sin_port = htons(port);
-  broadcast_addr.sin_addr.s_addr = inet_addr(ip.c_str());
-
-  const size_t MAX_UDP_PAYLOAD = 65507;
+struct ClientState {
+  sockaddr_in addr;
+  uint32_t acked = 0;
+  std::chrono::steady_clock::time_point last_ack;
+  bool has_view = false;
+  AABB view;
+  // what this client was sent, as baselines for its deltas
+  SnapshotHistory history;
+};
+
+// clients that have not acked for this long are dropped
+const std::chrono::seconds CLIENT_TIMEOUT(5);
+// full snapshots are broadcast this often so new clients can join
+const std::chrono::seconds KEYFRAME_INTERVAL(1);
+
+// incomplete snapshots are applied in part and dropped after this long
+const std::chrono::milliseconds REASSEMBLY_TIMEOUT(200);
+// share of the view size clients add on each side of the region they report
+const float VIEW_MARGIN = 0.25f;
+
+// registers a new client or advances the baseline and view of a known one
+static void register_ack(const char *data, size_t size,
+                         const sockaddr_in &sender_addr,
+                         std::vector<ClientState> &clients) {
+  Ack ack;
+  if (!decodeAck(data, size, ack))
+    return;
+
+  auto client = std::find_if(
+      clients.begin(), clients.end(), [&](const ClientState &known) {
+        return known.addr.sin_addr.s_addr == sender_addr.sin_addr.s_addr &&
+               known.addr.sin_port == sender_addr.sin_port;
+      });
+
+  if (client == clients.end()) {
+    clients.emplace_back();
+    client = clients.end() - 1;
+    client->addr = sender_addr;
+    client->acked = ack.sequence;
+    client->has_view = ack.hasView;
+    client->view = ack.view;
+  } else if (sequenceNewer(ack.sequence, client->acked)) {
+    client->acked = ack.sequence;
+    client->has_view = ack.hasView;
+    client->view = ack.view;
+  }
+  client->last_ack = std::chrono::steady_clock::now();
+}
 
-  while (clientRunning) {
-    {
-      std::lock_guard<std::mutex> lock(*planets_mutex);
-      applyGravity(*planets, *G, *timeStep);
-      applyCollision(*planets);
+// takes every queued ack and drops clients that went quiet
+static void receive_acks(int sockfd, DatagramReceiver &receiver,
+                         std::vector<ClientState> &clients) {
+  int received;
+  do {
+    received = receiver.receive(sockfd, false);
+    for (int k = 0; k < received; k++) {
+      register_ack(receiver.data(k), receiver.size(k), receiver.sender(k),
+                   clients);
     }
+  } while (received == static_cast<int>(DatagramReceiver::BATCH_SIZE));
 
-    std::vector<char> buffer;
-
-    {
-      std::lock_guard<std::mutex> lock(*planets_mutex);
-
-      int32_t num_planets = static_cast<int32_t>(planets->size());
-
-      size_t required_size =
-          sizeof(int32_t) + num_planets * 6 * sizeof(float) + num_planets * 3;
-
-      if (required_size > MAX_UDP_PAYLOAD) {
-        int32_t max_planets =
-            (MAX_UDP_PAYLOAD - sizeof(int32_t)) / (6 * sizeof(float) + 3);
-        num_planets = max_planets;
-        required_size = sizeof(int32_t) + num_planets * (6 * sizeof(float) + 3);
-
-        std::cerr << "Warning: too many planets (" << planets->size()
-                  << "), truncating to " << num_planets
-                  << " (packet size: " << required_size << " bytes)"
-                  << std::endl;
-      }
+  if (received < 0) {
+    perror("recvmmsg failed for acks");
+  }
 
-      buffer.resize(required_size);
-      char *ptr = buffer.data();
-
-      int32_t net_num_planets = htonl(num_planets);
-      memcpy(ptr, &net_num_planets, sizeof(int32_t));
-      ptr += sizeof(int32_t);
-
-      for (int i = 0; i < num_planets; i++) {
-        const auto &planet = planets->at(i);
-        float x = planet.getPosition().x;
-        float y = planet.getPosition().y;
-        float r = planet.getRadius();
-        float m = planet.getMass();
-        float velocity_x = planet.getVelocity().x;
-        float velocity_y = planet.getVelocity().y;
-
-        std::uint8_t color_r = planet.getShape().getFillColor().r;
-        std::uint8_t color_g = planet.getShape().getFillColor().g;
-        std::uint8_t color_b = planet.getShape().getFillColor().b;
-
-        uint32_t net_x = float_to_network(x);
-        uint32_t net_y = float_to_network(y);
-        uint32_t net_r = float_to_network(r);
-        uint32_t net_m = float_to_network(m);
-        uint32_t net_velocity_x = float_to_network(velocity_x);
-        uint32_t net_velocity_y = float_to_network(velocity_y);
-
-        memcpy(ptr, &net_x, sizeof(uint32_t));
-        ptr += sizeof(uint32_t);
-
-        memcpy(ptr, &net_y, sizeof(uint32_t));
-        ptr += sizeof(uint32_t);
-
-        memcpy(ptr, &net_r, sizeof(uint32_t));
-        ptr += sizeof(uint32_t);
-
-        memcpy(ptr, &net_m, sizeof(uint32_t));
-        ptr += sizeof(uint32_t);
-
-        memcpy(ptr, &net_velocity_x, sizeof(uint32_t));
-        ptr += sizeof(uint32_t);
-        memcpy(ptr, &net_velocity_y, sizeof(uint32_t));
-        ptr += sizeof(uint32_t);
-
-        *ptr++ = color_r;
-        *ptr++ = color_g;
-        *ptr++ = color_b;
-      }
-    }
+  auto now = std::chrono::steady_clock::now();
+  clients.erase(std::remove_if(clients.begin(), clients.end(),
+                               [&](const ClientState &client) {
+                                 return now - client.last_ack > CLIENT_TIMEOUT;
+                               }),
+                clients.end());
+}
 
-    int bytes_sent = sendto(sockfd, buffer.data(), buffer.size(), 0,
-                            (const struct sockaddr *)&broadcast_addr,
-                            sizeof(broadcast_addr));
+// flags the bodies in the client's view, and a rotating share of the others
+static void mark_fresh(const ClientState &client, const Snapshot &snapshot,
+                       BodyTree &view_tree, int offscreen_interval,
+                       std::vector<uint8_t> &fresh) {
+  fresh.assign(snapshot.size(), 0);
+  for (uint32_t i : view_tree.queryRegion(client.view)) {
+    fresh[i] = 1;
+  }
 
-    if (bytes_sent < 0) {
-      perror("sendto failed in broadcast");
-    } else if (bytes_sent != static_cast<int>(buffer.size())) {
-      std::cerr << "Warning: sent " << bytes_sent << " bytes, expected "
-                << buffer.size() << std::endl;
+  uint32_t interval = static_cast<uint32_t>(std::max(1, offscreen_interval));
+  uint32_t phase = snapshot.sequence % interval;
+  for (size_t i = 0; i < snapshot.size(); i++) {
+    if (snapshot.id[i] % interval == phase) {
+      fresh[i] = 1;
     }
+  }
+}
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+// appends the bodies the UI asked for, unless it is adding one right now
+static void take_requests(BodyRequests *requests, BodyStore &bodies) {
+  if (!requests)
+    return;
+  std::unique_lock<std::mutex> lock(requests->mutex, std::try_to_lock);
+  if (!lock.owns_lock())
+    return;
+
+  const BodyStore &added = requests->bodies;
+  for (size_t k = 0; k < added.size(); k++) {
+    size_t i = bodies.add(added.radius[k], added.mass[k]);
+    bodies.x[i] = added.x[k];
+    bodies.y[i] = added.y[k];
+    bodies.vx[i] = added.vx[k];
+    bodies.vy[i] = added.vy[k];
+    bodies.color[i] = added.color[k];
   }
+  requests->bodies.clear();
 }
 
-void client_receive(int sockfd, std::vector<Planet> *planets,
-                    std::mutex *planets_mutex,
-                    std::vector<std::vector<sf::Vertex>> *trajectories) {
-  struct sockaddr_in sender_addr;
-  socklen_t sender_len = sizeof(sender_addr);
-  char buffer[65507];
+// copies into the vectors of a state published earlier, so readers get
+// their copy without allocating once body counts stop growing
+static void publish_state(TripleBuffer<PublishedState> *published,
+                          const BodyStore &bodies, uint64_t tick,
+                          int64_t time, float time_scale) {
+  if (!published)
+    return;
+
+  PublishedState &state = published->back();
+  state.bodies.id.assign(bodies.id.begin(), bodies.id.end());
+  state.bodies.nextId = bodies.nextId;
+  state.bodies.x.assign(bodies.x.begin(), bodies.x.end());
+  state.bodies.y.assign(bodies.y.begin(), bodies.y.end());
+  state.bodies.vx.assign(bodies.vx.begin(), bodies.vx.end());
+  state.bodies.vy.assign(bodies.vy.begin(), bodies.vy.end());
+  state.bodies.mass.assign(bodies.mass.begin(), bodies.mass.end());
+  state.bodies.radius.assign(bodies.radius.begin(), bodies.radius.end());
+  state.bodies.color.assign(bodies.color.begin(), bodies.color.end());
+  state.tick = tick;
+  state.time = time;
+  state.timeScale = time_scale;
+  published->publish();
+}
 
-  while (clientRunning) {
-    int bytes_received = recvfrom(sockfd, buffer, sizeof(buffer), 0,
-                                  (struct sockaddr *)&sender_addr, &sender_len);
+// folds the time since `start` into a stage's moving average
+static void record_stage(std::atomic<float> &average,
+                         std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<float, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  average = average * 0.9f + elapsed.count() * 0.1f;
+}
 
-    if (bytes_received > 0) {
-      if (bytes_received >= static_cast<int>(sizeof(int32_t))) {
+// Hands states from the physics stage to the send stage. A state the send
+// stage has not picked up yet is replaced, so a slow network drops sends
+// instead of holding back the simulation.
+struct SendQueue {
+  TripleBuffer<PublishedState> states;
+  std::mutex mutex;
+  std::condition_variable ready;
+  bool pending = false;
+  bool stopped = false;
+};
+
+// the send stage: encodes and sends each state it is handed, as a keyframe
+// broadcast or as per-client deltas
+static void send_snapshots(int sockfd, sockaddr_in broadcast_addr,
+                           ServerSettings *server, SendQueue *queue,
+                           TickStats *tick_stats) {
+  Snapshot snapshot;
+  QuantizationFrame frame;
+  uint32_t sequence = 0;
+  std::vector<ClientState> clients;
+  SnapshotEncoder encoder;
+  DatagramSender sender;
+  DatagramReceiver receiver;
+  BodyTree view_tree;
+  std::vector<uint8_t> fresh;
+  std::chrono::steady_clock::time_point last_keyframe;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(queue->mutex);
+      queue->ready.wait(lock, [&] { return queue->pending || queue->stopped; });
+      if (queue->stopped)
+        return;
+      queue->pending = false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    queue->states.update();
+    const PublishedState &state = queue->states.front();
 
-        int32_t num_planets;
-        memcpy(&num_planets, buffer, sizeof(int32_t));
-        num_planets = ntohl(num_planets);
+    receive_acks(sockfd, receiver, clients);
 
-        size_t expected_size =
-            sizeof(int32_t) + num_planets * 6 * sizeof(float) + num_planets * 3;
-        if (bytes_received >= static_cast<int>(expected_size)) {
+    // sequence 0 means "no baseline"
+    if (++sequence == 0) {
+      sequence = 1;
+    }
+    bool any_view = std::any_of(
+        clients.begin(), clients.end(),
+        [](const ClientState &client) { return client.has_view; });
+    snapshot.capture(state.bodies, state.bodies.size(), sequence);
+    snapshot.time = state.time;
+    snapshot.timeScale = state.timeScale;
+    if (any_view) {
+      view_tree.update(state.bodies);
+    }
+    snapshot.quantize(server->wire, frame);
+
+    if (start - last_keyframe >= KEYFRAME_INTERVAL) {
+      last_keyframe = start;
+      encoder.encode(snapshot, nullptr);
+      sender.send(sockfd, encoder, broadcast_addr);
+      for (ClientState &client : clients) {
+        client.history.slot(sequence) = snapshot;
+      }
+      record_stage(tick_stats->sendMs, start);
+      continue;
+    }
 
-          const char *data_ptr = buffer + sizeof(int32_t);
+    for (ClientState &client : clients) {
+      // deltas against the newest snapshot the client confirmed, or a full
+      // snapshot once that has left the history
+      Snapshot &sent = client.history.slot(sequence);
+      const Snapshot *baseline = client.history.find(client.acked);
+      if (baseline == &sent) {
+        baseline = nullptr;
+      }
 
-          std::vector<Planet> new_planets;
-          new_planets.reserve(num_planets);
+      // bodies out of view keep what the client has until their turn
+      if (baseline && client.has_view) {
+        mark_fresh(client, snapshot, view_tree, server->offscreenInterval,
+                   fresh);
+        sent.captureFresh(snapshot, *baseline, fresh);
+      } else {
+        sent = snapshot;
+      }
 
-          std::vector<std::vector<sf::Vertex>> new_trajectories;
-          new_trajectories.reserve(num_planets);
+      encoder.encode(sent, baseline);
+      sender.send(sockfd, encoder, client.addr);
+    }
+    record_stage(tick_stats->sendMs, start);
+  }
+}
 
-          for (int i = 0; i < num_planets; i++) {
-            uint32_t net_x, net_y, net_r, net_m, net_vx, net_vy;
+void server_send_broadcast(int sockfd, BodyStore *bodies,
+                           TripleBuffer<PublishedState> *published,
+                           BodyRequests *requests, int port,
+                           const std::string &ip, PhysicsSettings *physics,
+                           ServerSettings *server, TickStats *tick_stats) {
+  struct sockaddr_in broadcast_addr;
+  memset(&broadcast_addr, 0, sizeof(broadcast_addr));
 
-            memcpy(&net_x, data_ptr, sizeof(uint32_t));
-            data_ptr += sizeof(uint32_t);
-            memcpy(&net_y, data_ptr, sizeof(uint32_t));
-            data_ptr += sizeof(uint32_t);
+  broadcast_addr.sin_family = AF_INET;
+  broadcast_addr.sin_port = htons(port);
+  broadcast_addr.sin_addr.s_addr = inet_addr(ip.c_str());
 
-            memcpy(&net_r, data_ptr, sizeof(uint32_t));
-            data_ptr += sizeof(uint32_t);
+  ThreadPool pool(physics->threads);
+  CollisionState collision;
+  TickScheduler scheduler(server->tickRate, server->overrunPolicy, tick_stats);
+  uint64_t ticks_run = 0;
+  uint64_t ticks_since_send = 0;
 
-            memcpy(&net_m, data_ptr, sizeof(uint32_t));
-            data_ptr += sizeof(uint32_t);
+  // tick N is encoded and sent while tick N + 1 is simulated
+  SendQueue queue;
+  std::thread send_thread(send_snapshots, sockfd, broadcast_addr, server,
+                          &queue, tick_stats);
 
-            memcpy(&net_vx, data_ptr, sizeof(uint32_t));
-            data_ptr += sizeof(uint32_t);
-            memcpy(&net_vy, data_ptr, sizeof(uint32_t));
-            data_ptr += sizeof(uint32_t);
+  while (clientRunning) {
+    scheduler.setTickRate(server->tickRate);
+    scheduler.setPolicy(server->overrunPolicy);
+    uint64_t ticks = scheduler.wait();
+    auto start = std::chrono::steady_clock::now();
 
-            float x = network_to_float(net_x);
-            float y = network_to_float(net_y);
-            float r = network_to_float(net_r);
-            float m = network_to_float(net_m);
-            float vx = network_to_float(net_vx);
-            float vy = network_to_float(net_vy);
+    pool.resize(physics->threads);
 
-            std::uint8_t color_r = static_cast<std::uint8_t>(*data_ptr++);
-            std::uint8_t color_g = static_cast<std::uint8_t>(*data_ptr++);
-            std::uint8_t color_b = static_cast<std::uint8_t>(*data_ptr++);
+    take_requests(requests, *bodies);
 
-            sf::Color sf_color(color_r, color_g, color_b);
+    uint64_t steps = ticks * std::max(1, server->substeps);
+    for (uint64_t step = 0; step < steps; step++) {
+      applyGravity(*bodies, *physics, pool);
+      applyCollision(*bodies, *physics, collision);
+    }
+    record_stage(tick_stats->physicsMs, start);
+
+    start = std::chrono::steady_clock::now();
+    ticks_run += ticks;
+    int64_t time = scheduler.tickTime() / 1000;
+    float time_scale =
+        physics->timeStep * std::max(1, server->substeps) * server->tickRate;
+    publish_state(published, *bodies, ticks_run, time, time_scale);
+
+    ticks_since_send += ticks;
+    if (ticks_since_send >= static_cast<uint64_t>(server->sendInterval)) {
+      ticks_since_send = 0;
+      publish_state(&queue.states, *bodies, ticks_run, time, time_scale);
+      {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.pending) {
+          tick_stats->droppedSends++;
+        }
+        queue.pending = true;
+      }
+      queue.ready.notify_one();
+    }
+    record_stage(tick_stats->publishMs, start);
+  }
 
-            // planet creation
-            Planet p(r, m);
-            p.setPosition(sf::Vector2f(x, y));
-            p.setVelocity(sf::Vector2f(vx, vy));
-            p.setColor(color_r, color_g, color_b);
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.stopped = true;
+  }
+  queue.ready.notify_one();
+  send_thread.join();
+}
 
-            new_planets.push_back(p);
+// the reported view, grown by VIEW_MARGIN so bodies are fresh before they
+// scroll in
+static void read_view(ClientView *view, Ack &ack) {
+  if (!view)
+    return;
+
+  std::lock_guard<std::mutex> lock(view->mutex);
+  ack.hasView = view->known;
+  const AABB &region = view->region;
+  float margin_x = (region.maxX - region.minX) * VIEW_MARGIN;
+  float margin_y = (region.maxY - region.minY) * VIEW_MARGIN;
+  ack.view = {region.minX - margin_x, region.minY - margin_y,
+              region.maxX + margin_x, region.maxY + margin_y};
+}
 
-            std::vector<sf::Vertex> trajectory;
-            sf::Color trailColor(color_r, color_g, color_b, 200);
-            trajectory.push_back(sf::Vertex(sf::Vector2f(x, y), trailColor));
-            new_trajectories.push_back(std::move(trajectory));
+void client_receive(int sockfd, InterpolationBuffer *interpolation,
+                    ClientView *view) {
+  DatagramReceiver receiver;
+  char ack[MAX_ACK_SIZE];
 
-            std::cout << i << ") " << " x: " << x << " y: " << y << " r: " << r
-                      << " m: " << m << " color: " << (int)color_r << "_"
-                      << (int)color_g << "_" << (int)color_b << "\n";
-          }
+  SnapshotAssembler assembler;
+  // newest state received, complete or patched from a partial snapshot
+  Snapshot state;
 
-          std::lock_guard<std::mutex> lock(*planets_mutex);
-          {
-            *planets = std::move(new_planets);
-          }
+  while (clientRunning) {
+    if (assembler.flushExpired(REASSEMBLY_TIMEOUT, state)) {
+      interpolation->push(state, std::chrono::steady_clock::now());
+    }
 
-        } else {
-          std::cerr << "Incomplete packet received: " << bytes_received
-                    << " bytes, expected " << expected_size << std::endl;
-        }
+    // drain the socket; of the snapshots completed on the way only the
+    // newest is acked and shown
+    const Snapshot *newest = nullptr;
+    uint32_t newest_sequence = 0;
+    sockaddr_in server_addr;
+    std::chrono::steady_clock::time_point arrival;
+
+    int received;
+    bool wait = true;
+    do {
+      received = receiver.receive(sockfd, wait);
+      wait = false;
+
+      for (int k = 0; k < received; k++) {
+        const Snapshot *snapshot =
+            assembler.add(receiver.data(k), receiver.size(k));
+        if (!snapshot ||
+            (newest && !sequenceNewer(snapshot->sequence, newest_sequence)))
+          continue;
+
+        newest = snapshot;
+        newest_sequence = snapshot->sequence;
+        server_addr = receiver.sender(k);
+        arrival = std::chrono::steady_clock::now();
       }
-    } else if (bytes_received < 0) {
-      perror("recvfrom failed");
+    } while (received == static_cast<int>(DatagramReceiver::BATCH_SIZE));
+
+    if (received < 0) {
+      perror("recvmmsg failed");
     }
+    // a much older snapshot completed later may have taken its slot
+    if (!newest || newest->sequence != newest_sequence)
+      continue;
+
+    // every decoded snapshot can serve as a baseline, even a late one
+    Ack reply;
+    reply.sequence = newest_sequence;
+    read_view(view, reply);
+    size_t ack_size = encodeAck(reply, ack);
+    sendto(sockfd, ack, ack_size, 0, (const struct sockaddr *)&server_addr,
+           sizeof(server_addr));
+
+    if (state.sequence != 0 && !sequenceNewer(newest_sequence, state.sequence))
+      continue;
+    // copies into buffers kept from earlier snapshots
+    state = *newest;
+    interpolation->push(state, arrival);
   }
 }
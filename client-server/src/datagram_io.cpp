@@ -0,0 +1,115 @@
+#include "datagram_io.hpp"
+#include "snapshot.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
+
+#ifdef __linux__
+DatagramSender::DatagramSender() : headers(BATCH_SIZE), vectors(BATCH_SIZE) {}
+#else
+DatagramSender::DatagramSender() {}
+#endif
+
+void DatagramSender::send(int sockfd, const SnapshotEncoder &encoder,
+                          const sockaddr_in &addr) {
+  size_t total = encoder.size();
+
+#ifdef __linux__
+  size_t sent = 0;
+  while (sent < total) {
+    size_t batch = std::min(total - sent, BATCH_SIZE);
+    for (size_t k = 0; k < batch; k++) {
+      const std::vector<char> &fragment = encoder.fragment(sent + k);
+      vectors[k].iov_base = const_cast<char *>(fragment.data());
+      vectors[k].iov_len = fragment.size();
+
+      msghdr &message = headers[k].msg_hdr;
+      memset(&message, 0, sizeof(message));
+      message.msg_name = const_cast<sockaddr_in *>(&addr);
+      message.msg_namelen = sizeof(addr);
+      message.msg_iov = &vectors[k];
+      message.msg_iovlen = 1;
+    }
+
+    int result = sendmmsg(sockfd, headers.data(), batch, 0);
+    if (result < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("sendmmsg failed in broadcast");
+      return;
+    }
+    sent += result;
+  }
+#else
+  for (size_t k = 0; k < total; k++) {
+    const std::vector<char> &fragment = encoder.fragment(k);
+    if (sendto(sockfd, fragment.data(), fragment.size(), 0,
+               (const struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      perror("sendto failed in broadcast");
+      return;
+    }
+  }
+#endif
+}
+
+#ifdef __linux__
+DatagramReceiver::DatagramReceiver()
+    : buffers(BATCH_SIZE * DATAGRAM_SIZE), sizes(BATCH_SIZE),
+      senders(BATCH_SIZE), headers(BATCH_SIZE), vectors(BATCH_SIZE) {}
+#else
+DatagramReceiver::DatagramReceiver()
+    : buffers(DATAGRAM_SIZE), sizes(1), senders(1) {}
+#endif
+
+int DatagramReceiver::receive(int sockfd, bool wait) {
+#ifdef __linux__
+  for (size_t k = 0; k < BATCH_SIZE; k++) {
+    vectors[k].iov_base = buffers.data() + k * DATAGRAM_SIZE;
+    vectors[k].iov_len = DATAGRAM_SIZE;
+
+    msghdr &message = headers[k].msg_hdr;
+    memset(&message, 0, sizeof(message));
+    message.msg_name = &senders[k];
+    message.msg_namelen = sizeof(sockaddr_in);
+    message.msg_iov = &vectors[k];
+    message.msg_iovlen = 1;
+  }
+
+  int result = recvmmsg(sockfd, headers.data(), BATCH_SIZE,
+                        wait ? MSG_WAITFORONE : MSG_DONTWAIT, nullptr);
+  for (int k = 0; k < result; k++) {
+    bool truncated = headers[k].msg_hdr.msg_flags & MSG_TRUNC;
+    sizes[k] = truncated ? 0 : headers[k].msg_len;
+  }
+#else
+  socklen_t sender_len = sizeof(sockaddr_in);
+  int result = recvfrom(sockfd, buffers.data(), DATAGRAM_SIZE,
+                        wait ? 0 : MSG_DONTWAIT,
+                        (struct sockaddr *)&senders[0], &sender_len);
+  if (result >= 0) {
+    sizes[0] = static_cast<size_t>(result);
+    result = 1;
+  }
+#endif
+
+  if (result < 0 &&
+      (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+    return 0;
+  return result;
+}
+
+const char *DatagramReceiver::data(size_t index) const {
+  return buffers.data() + index * DATAGRAM_SIZE;
+}
+
+size_t DatagramReceiver::size(size_t index) const { return sizes[index]; }
+
+const sockaddr_in &DatagramReceiver::sender(size_t index) const {
+  return senders[index];
+}
@@ -0,0 +1,92 @@
+#include "gravity_kernels.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Times every kernel this CPU supports on one thread over the same random
+// scene and reports the worst per-planet relative error of the vector
+// kernels against the scalar reference, |a - a_scalar| / |a_scalar|.
+// Arguments: planet counts, 2000 5000 10000 by default.
+
+static const GravityKernel KERNELS[] = {
+    GravityKernel::Scalar, GravityKernel::Avx2, GravityKernel::Avx512};
+
+// best of a few runs, in milliseconds
+static double timeKernel(GravityKernel kernel, const std::vector<float> &x,
+                         const std::vector<float> &y,
+                         const std::vector<float> &mass, float G,
+                         std::vector<float> &ax, std::vector<float> &ay) {
+  size_t count = x.size();
+  int repeats = count <= 2000 ? 20 : count <= 5000 ? 8 : 4;
+  double best = 1e30;
+  for (int r = 0; r < repeats; r++) {
+    auto start = std::chrono::steady_clock::now();
+    computeGravity(kernel, x.data(), y.data(), mass.data(), count, G, 0,
+                   count, ax.data(), ay.data());
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+int main(int argc, char **argv) {
+  std::vector<size_t> counts;
+  for (int i = 1; i < argc; i++)
+    counts.push_back(std::strtoul(argv[i], nullptr, 10));
+  if (counts.empty())
+    counts = {2000, 5000, 10000};
+
+  const float G = 10.0f;
+  std::cout << std::setw(8) << "planets" << std::setw(10) << "kernel"
+            << std::setw(12) << "ms" << std::setw(10) << "speedup"
+            << std::setw(14) << "max rel err" << std::endl;
+
+  for (size_t count : counts) {
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> position(0.0f, 4000.0f);
+    std::uniform_real_distribution<float> weight(1.0f, 100.0f);
+    std::vector<float> x(count), y(count), mass(count);
+    for (size_t i = 0; i < count; i++) {
+      x[i] = position(random);
+      y[i] = position(random);
+      mass[i] = weight(random);
+    }
+
+    std::vector<float> scalarX(count), scalarY(count);
+    std::vector<float> ax(count), ay(count);
+    double scalarTime = 0.0;
+    for (GravityKernel kernel : KERNELS) {
+      if (!gravityKernelSupported(kernel))
+        continue;
+      bool scalar = kernel == GravityKernel::Scalar;
+      double time = timeKernel(kernel, x, y, mass, G, scalar ? scalarX : ax,
+                               scalar ? scalarY : ay);
+      if (scalar)
+        scalarTime = time;
+
+      double worst = 0.0;
+      for (size_t i = 0; i < count && !scalar; i++) {
+        double referenceX = scalarX[i], referenceY = scalarY[i];
+        double reference = std::hypot(referenceX, referenceY);
+        if (reference == 0.0)
+          continue;
+        double error = std::hypot(ax[i] - referenceX, ay[i] - referenceY);
+        worst = std::max(worst, error / reference);
+      }
+
+      std::cout << std::setw(8) << count << std::setw(10)
+                << gravityKernelName(kernel) << std::setw(12) << std::fixed
+                << std::setprecision(2) << time << std::setw(9)
+                << std::setprecision(1) << scalarTime / time << "x"
+                << std::setw(14) << std::scientific << std::setprecision(1)
+                << worst << std::defaultfloat << std::endl;
+    }
+  }
+  return 0;
+}
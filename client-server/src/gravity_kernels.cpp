@@ -0,0 +1,212 @@
+#include "gravity_kernels.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GRAVITY_X86 1
+#endif
+
+// sources per tile: x, y and mass of one tile stay in L1 while every target
+// group runs over it
+static const size_t SOURCE_TILE = 1024;
+
+// reference kernel, same arithmetic as the original applyGravity loop
+static void gravityScalar(const float *x, const float *y, const float *mass,
+                          size_t count, float G, size_t begin, size_t end,
+                          float *ax, float *ay) {
+  for (size_t i = begin; i < end; i++) {
+    float totalForceX = 0.0f, totalForceY = 0.0f;
+
+    for (size_t j = 0; j < count; j++) {
+      if (i == j)
+        continue;
+
+      float directionX = x[j] - x[i];
+      float directionY = y[j] - y[i];
+
+      float distance =
+          std::sqrt(directionX * directionX + directionY * directionY);
+
+      if (distance < 1.0f)
+        continue;
+
+      directionX /= distance;
+      directionY /= distance;
+
+      float forceMagnitude = G * mass[i] * mass[j] / (distance * distance);
+
+      totalForceX += directionX * forceMagnitude;
+      totalForceY += directionY * forceMagnitude;
+    }
+
+    ax[i] = totalForceX / mass[i];
+    ay[i] = totalForceY / mass[i];
+  }
+}
+
+#ifdef GRAVITY_X86
+__attribute__((target("avx2,fma"))) static void
+gravityAvx2(const float *x, const float *y, const float *mass, size_t count,
+            float G, size_t begin, size_t end, float *ax, float *ay) {
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 threeHalves = _mm256_set1_ps(1.5f);
+  const __m256i laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+  std::fill(ax + begin, ax + end, 0.0f);
+  std::fill(ay + begin, ay + end, 0.0f);
+
+  for (size_t tile = 0; tile < count; tile += SOURCE_TILE) {
+    size_t tileEnd = std::min(count, tile + SOURCE_TILE);
+
+    for (size_t i = begin; i < end; i += 8) {
+      int lanes = static_cast<int>(std::min<size_t>(8, end - i));
+      __m256i mask =
+          _mm256_cmpgt_epi32(_mm256_set1_epi32(lanes), laneIndex);
+
+      __m256 px = _mm256_maskload_ps(x + i, mask);
+      __m256 py = _mm256_maskload_ps(y + i, mask);
+      __m256 accX = _mm256_maskload_ps(ax + i, mask);
+      __m256 accY = _mm256_maskload_ps(ay + i, mask);
+
+      for (size_t j = tile; j < tileEnd; j++) {
+        __m256 dx = _mm256_sub_ps(_mm256_set1_ps(x[j]), px);
+        __m256 dy = _mm256_sub_ps(_mm256_set1_ps(y[j]), py);
+        __m256 distanceSq = _mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy));
+
+        // rsqrt estimate plus one Newton-Raphson step
+        __m256 inv = _mm256_rsqrt_ps(distanceSq);
+        __m256 invSq = _mm256_mul_ps(inv, inv);
+        inv = _mm256_mul_ps(
+            inv, _mm256_fnmadd_ps(_mm256_mul_ps(half, distanceSq), invSq,
+                                  threeHalves));
+        invSq = _mm256_mul_ps(inv, inv);
+
+        // drops the target itself and anything closer than 1 unit
+        __m256 near = _mm256_cmp_ps(distanceSq, one, _CMP_GE_OQ);
+        __m256 scale = _mm256_mul_ps(_mm256_set1_ps(G * mass[j]),
+                                     _mm256_mul_ps(inv, invSq));
+        scale = _mm256_and_ps(near, scale);
+
+        accX = _mm256_fmadd_ps(dx, scale, accX);
+        accY = _mm256_fmadd_ps(dy, scale, accY);
+      }
+
+      _mm256_maskstore_ps(ax + i, mask, accX);
+      _mm256_maskstore_ps(ay + i, mask, accY);
+    }
+  }
+}
+
+__attribute__((target("avx512f"))) static void
+gravityAvx512(const float *x, const float *y, const float *mass, size_t count,
+              float G, size_t begin, size_t end, float *ax, float *ay) {
+  const __m512 one = _mm512_set1_ps(1.0f);
+  const __m512 half = _mm512_set1_ps(0.5f);
+  const __m512 threeHalves = _mm512_set1_ps(1.5f);
+
+  std::fill(ax + begin, ax + end, 0.0f);
+  std::fill(ay + begin, ay + end, 0.0f);
+
+  for (size_t tile = 0; tile < count; tile += SOURCE_TILE) {
+    size_t tileEnd = std::min(count, tile + SOURCE_TILE);
+
+    for (size_t i = begin; i < end; i += 16) {
+      size_t lanes = std::min<size_t>(16, end - i);
+      __mmask16 mask = static_cast<__mmask16>((1u << lanes) - 1);
+
+      __m512 px = _mm512_maskz_loadu_ps(mask, x + i);
+      __m512 py = _mm512_maskz_loadu_ps(mask, y + i);
+      __m512 accX = _mm512_maskz_loadu_ps(mask, ax + i);
+      __m512 accY = _mm512_maskz_loadu_ps(mask, ay + i);
+
+      for (size_t j = tile; j < tileEnd; j++) {
+        __m512 dx = _mm512_sub_ps(_mm512_set1_ps(x[j]), px);
+        __m512 dy = _mm512_sub_ps(_mm512_set1_ps(y[j]), py);
+        __m512 distanceSq = _mm512_fmadd_ps(dx, dx, _mm512_mul_ps(dy, dy));
+
+        __m512 inv = _mm512_rsqrt14_ps(distanceSq);
+        __m512 invSq = _mm512_mul_ps(inv, inv);
+        inv = _mm512_mul_ps(
+            inv, _mm512_fnmadd_ps(_mm512_mul_ps(half, distanceSq), invSq,
+                                  threeHalves));
+        invSq = _mm512_mul_ps(inv, inv);
+
+        __mmask16 near = _mm512_cmp_ps_mask(distanceSq, one, _CMP_GE_OQ);
+        __m512 scale = _mm512_maskz_mul_ps(
+            near, _mm512_set1_ps(G * mass[j]), _mm512_mul_ps(inv, invSq));
+
+        accX = _mm512_fmadd_ps(dx, scale, accX);
+        accY = _mm512_fmadd_ps(dy, scale, accY);
+      }
+
+      _mm512_mask_storeu_ps(ax + i, mask, accX);
+      _mm512_mask_storeu_ps(ay + i, mask, accY);
+    }
+  }
+}
+#endif
+
+bool gravityKernelSupported(GravityKernel kernel) {
+  switch (kernel) {
+  case GravityKernel::Auto:
+  case GravityKernel::Scalar:
+    return true;
+#ifdef GRAVITY_X86
+  case GravityKernel::Avx2:
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  case GravityKernel::Avx512:
+    return __builtin_cpu_supports("avx512f");
+#endif
+  default:
+    return false;
+  }
+}
+
+GravityKernel detectGravityKernel() {
+  static const GravityKernel detected = [] {
+    if (gravityKernelSupported(GravityKernel::Avx512))
+      return GravityKernel::Avx512;
+    if (gravityKernelSupported(GravityKernel::Avx2))
+      return GravityKernel::Avx2;
+    return GravityKernel::Scalar;
+  }();
+  return detected;
+}
+
+const char *gravityKernelName(GravityKernel kernel) {
+  switch (kernel) {
+  case GravityKernel::Auto:
+    return "Auto";
+  case GravityKernel::Scalar:
+    return "Scalar";
+  case GravityKernel::Avx2:
+    return "AVX2";
+  case GravityKernel::Avx512:
+    return "AVX-512";
+  }
+  return "Unknown";
+}
+
+void computeGravity(GravityKernel kernel, const float *x, const float *y,
+                    const float *mass, size_t count, float G, size_t begin,
+                    size_t end, float *ax, float *ay) {
+  if (kernel == GravityKernel::Auto || !gravityKernelSupported(kernel))
+    kernel = detectGravityKernel();
+
+  switch (kernel) {
+#ifdef GRAVITY_X86
+  case GravityKernel::Avx2:
+    gravityAvx2(x, y, mass, count, G, begin, end, ax, ay);
+    break;
+  case GravityKernel::Avx512:
+    gravityAvx512(x, y, mass, count, G, begin, end, ax, ay);
+    break;
+#endif
+  default:
+    gravityScalar(x, y, mass, count, G, begin, end, ax, ay);
+    break;
+  }
+}
@@ -0,0 +1,158 @@
+#include "interpolation.hpp"
+#include "body_store.hpp"
+#include "snapshot.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+
+static int64_t toMicroseconds(std::chrono::steady_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+// moves the bodies of `to`, already in `bodies`, back towards `from` by
+// 1 - alpha; bodies only in `to` appear at once, bodies only in `from` are
+// gone
+template <typename State>
+static void blend(const State &from, const State &to, float alpha,
+                  BodyStore &bodies) {
+  size_t f = 0;
+  for (size_t i = 0; i < to.size(); i++) {
+    while (f < from.size() && from.id[f] < to.id[i]) {
+      f++;
+    }
+    if (f == from.size())
+      break;
+    if (from.id[f] != to.id[i])
+      continue;
+
+    bodies.x[i] = from.x[f] + (to.x[i] - from.x[f]) * alpha;
+    bodies.y[i] = from.y[f] + (to.y[i] - from.y[f]) * alpha;
+    bodies.vx[i] = from.vx[f] + (to.vx[i] - from.vx[f]) * alpha;
+    bodies.vy[i] = from.vy[f] + (to.vy[i] - from.vy[f]) * alpha;
+  }
+}
+
+InterpolationBuffer::InterpolationBuffer() : slots(BUFFER_SIZE) {}
+
+const Snapshot &InterpolationBuffer::at(size_t age) const {
+  return slots[(newest + BUFFER_SIZE - age) % BUFFER_SIZE];
+}
+
+void InterpolationBuffer::push(const Snapshot &snapshot,
+                               std::chrono::steady_clock::time_point arrival) {
+  incoming = snapshot;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  int64_t arrivalTime = toMicroseconds(arrival);
+  int64_t offset = arrivalTime - static_cast<int64_t>(snapshot.time);
+
+  // a restarted server starts its clock over
+  if (count > 0 && snapshot.time <= at(0).time) {
+    count = 0;
+  }
+
+  if (count == 0) {
+    clockOffset = offset;
+  } else {
+    // follow clock drift and route changes by at most 1% of the time passed
+    int64_t slack = (arrivalTime - lastArrival) / 100;
+    clockOffset = std::min(offset, clockOffset + slack);
+  }
+  lastArrival = arrivalTime;
+
+  newest = (newest + 1) % BUFFER_SIZE;
+  std::swap(slots[newest], incoming);
+  count = std::min(count + 1, BUFFER_SIZE);
+}
+
+SampleState InterpolationBuffer::sample(
+    std::chrono::steady_clock::time_point now,
+    std::chrono::microseconds delay, BodyStore &bodies) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (count == 0)
+    return SampleState::Empty;
+
+  // render time on the server's clock
+  int64_t target = toMicroseconds(now) - clockOffset - delay.count();
+
+  const Snapshot &latest = at(0);
+  int64_t latestTime = static_cast<int64_t>(latest.time);
+  if (target > latestTime) {
+    int64_t ahead = std::min(target - latestTime, MAX_EXTRAPOLATION);
+    float seconds = latest.timeScale * static_cast<float>(ahead) * 1e-6f;
+
+    latest.apply(bodies);
+    for (size_t i = 0; i < bodies.size(); i++) {
+      bodies.x[i] += bodies.vx[i] * seconds;
+      bodies.y[i] += bodies.vy[i] * seconds;
+    }
+    return SampleState::Extrapolating;
+  }
+
+  // the newest snapshot at or before the render time
+  size_t age = 1;
+  while (age < count && static_cast<int64_t>(at(age).time) > target) {
+    age++;
+  }
+  // the delay reaches further back than the buffer
+  if (age == count) {
+    at(count - 1).apply(bodies);
+    return SampleState::Interpolating;
+  }
+
+  const Snapshot &from = at(age);
+  const Snapshot &to = at(age - 1);
+  float alpha = static_cast<float>(target - static_cast<int64_t>(from.time)) /
+                static_cast<float>(to.time - from.time);
+
+  to.apply(bodies);
+  blend(from, to, alpha, bodies);
+  return SampleState::Interpolating;
+}
+
+void TickInterpolator::push(const BodyStore &bodies, int64_t time,
+                            std::chrono::steady_clock::time_point arrival) {
+  // the copy goes into the older state's vectors
+  std::swap(previous, current);
+  previousTime = currentTime;
+  current = bodies;
+  currentTime = time;
+  this->arrival = arrival;
+  count = std::min<size_t>(count + 1, 2);
+}
+
+float TickInterpolator::sample(std::chrono::steady_clock::time_point now,
+                               BodyStore &bodies) const {
+  if (count == 0)
+    return 0.0f;
+
+  bodies = current;
+  int64_t tick = currentTime - previousTime;
+  // nothing to blend over
+  if (count < 2 || tick <= 0)
+    return 1.0f;
+
+  int64_t elapsed = toMicroseconds(now) - toMicroseconds(arrival);
+  float alpha = std::min(
+      1.0f, static_cast<float>(elapsed) / static_cast<float>(tick));
+  alpha = std::max(0.0f, alpha);
+  blend(previous, current, alpha, bodies);
+  return alpha;
+}
+
+const char *sampleStateName(SampleState state) {
+  switch (state) {
+  case SampleState::Empty:
+    return "Waiting for snapshots";
+  case SampleState::Interpolating:
+    return "Interpolating";
+  case SampleState::Extrapolating:
+    return "Extrapolating";
+  }
+  return "Unknown";
+}
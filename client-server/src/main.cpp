@@ -1,10 +1,17 @@
+#include "aabb_tree.hpp"
+#include "body_renderer.hpp"
 #include "client-server.hpp"
 #include "engine.hpp"
-#include "json/json.h"
+#include "interpolation.hpp"
+#include "scene.hpp"
+#include "trail_renderer.hpp"
+#include "triple_buffer.hpp"
 #include <SFML/System/Vector2.hpp>
 #include <X11/X.h>
+#include <algorithm>
 #include <arpa/inet.h>
 #include <atomic>
+#include <chrono>
 #include <cstring>
 #include <fcntl.h>
 #include <fstream>
@@ -24,6 +31,10 @@
 #define MAXLINE 1024
 #define JSON_USE_STRING_VIEW 0
 
+// input is handled and the panels are built at this rate, whatever the
+// display rate
+static constexpr int UI_FRAME_RATE = 60;
+
 #ifdef __linux__
 int flags = MSG_CONFIRM;
 #elif __APPLE__
@@ -39,6 +50,80 @@ struct ConnectionConfig {
   int port;
 };
 
+// Set by the UI thread, copied by the render thread at every frame.
+struct RenderControls {
+  sf::View camera;
+  int trailLength = 250;       // kept segments per body
+  float trailTolerance = 0.5f; // pixels a trail may stray from its path
+  bool clearTrails = false;
+  int interpolationDelay = 100; // milliseconds, clients only
+  int64_t selected = -1;
+  bool pick = false; // select the planet at `pickAt` in the next frame
+  sf::Vector2f pickAt;
+};
+
+// What the render thread drew last, for the UI to show.
+struct RenderReport {
+  size_t planets = 0;
+  size_t bodiesOnScreen = 0, bodiesCulled = 0;
+  size_t trails = 0, trailsOnScreen = 0;
+  SampleState sampleState = SampleState::Empty;
+  float tickAlpha = 0.0f; // host only
+  float frameMs = 0.0f;
+  // the selected planet, if `selected` is valid
+  int64_t selected = -1;
+  float radius = 0.0f, mass = 0.0f;
+  sf::Vector2f position, velocity;
+};
+
+struct RenderShared {
+  std::mutex mutex;
+  RenderControls controls;
+  RenderReport report;
+};
+
+// returns true when the planet should be deselected
+bool showSelectedPlanet(const RenderReport &report) {
+  ImGui::Separator();
+  ImGui::Text("Selected planet");
+
+  if (report.selected < 0) {
+    ImGui::Text("Click a planet to select it");
+    return false;
+  }
+
+  ImGui::Text("#%lld  radius %.1f  mass %.0f", (long long)report.selected,
+              report.radius, report.mass);
+  ImGui::Text("Position: %.1f, %.1f", report.position.x, report.position.y);
+  ImGui::Text("Velocity: %.1f, %.1f", report.velocity.x, report.velocity.y);
+  return ImGui::Button("Deselect");
+}
+
+void showRendering(const RenderReport &report) {
+  ImGui::Text("On screen: %zu planets, %zu trails", report.bodiesOnScreen,
+              report.trailsOnScreen);
+  ImGui::Text("Culled: %zu planets, %zu trails", report.bodiesCulled,
+              report.trails - report.trailsOnScreen);
+  ImGui::Text("Frame: %.2f ms", report.frameMs);
+}
+
+// bits == 0 sends 32-bit floats
+void precisionCombo(const char *label, int &bits, const int *options,
+                    int count) {
+  auto name = [](int value) {
+    return value == 0 ? std::string("Float") : std::to_string(value) + " bit";
+  };
+
+  if (ImGui::BeginCombo(label, name(bits).c_str())) {
+    for (int k = 0; k < count; k++) {
+      if (ImGui::Selectable(name(options[k]).c_str(), bits == options[k])) {
+        bits = options[k];
+      }
+    }
+    ImGui::EndCombo();
+  }
+}
+
 ConnectionConfig showLauncher() {
   sf::RenderWindow launcher(sf::VideoMode(400, 300), "Planet Sim Launcher");
   launcher.setFramerateLimit(60);
@@ -163,6 +248,135 @@ ConnectionConfig showLauncher() {
   return config;
 }
 
+// Owns the window's GL context and draws until `rendering` is cleared, as
+// fast as the frame rate limit allows. The host blends the last two states
+// its simulation published, a client samples the snapshots it received;
+// exactly one of `published` and `interpolation` is set. The ImGui frame
+// the UI thread built last is drawn on top, under `imguiMutex`.
+void renderLoop(sf::RenderWindow *window, std::mutex *imguiMutex,
+                RenderShared *shared, std::atomic<bool> *rendering,
+                TripleBuffer<PublishedState> *published,
+                InterpolationBuffer *interpolation, ClientView *clientView) {
+  window->setActive(true);
+
+  BodyStore shown;
+  TickInterpolator ticks;
+  RenderControls controls;
+  TrailRenderer trails(controls.trailLength);
+  BodyTree bodyTree;
+  BodyRenderer bodyRenderer;
+  sf::Clock frameClock;
+  float frameMs = 0.0f;
+
+  while (*rendering) {
+    {
+      std::lock_guard<std::mutex> lock(shared->mutex);
+      controls = shared->controls;
+      shared->controls.pick = false;
+      shared->controls.clearTrails = false;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    SampleState sampleState = SampleState::Interpolating;
+    float tickAlpha = 0.0f;
+    if (published) {
+      if (published->update()) {
+        const PublishedState &state = published->front();
+        ticks.push(state.bodies, state.time, now);
+      }
+      tickAlpha = ticks.sample(now, shown);
+    } else {
+      // clients draw the received state as it was a fixed delay ago
+      sampleState = interpolation->sample(
+          now, std::chrono::milliseconds(controls.interpolationDelay), shown);
+    }
+
+    const sf::View &camera = controls.camera;
+    window->setView(camera);
+    sf::Vector2f center = camera.getCenter();
+    sf::Vector2f half = camera.getSize() / 2.0f;
+    AABB viewBounds = {center.x - half.x, center.y - half.y, center.x + half.x,
+                       center.y + half.y};
+    if (clientView) {
+      std::lock_guard<std::mutex> lock(clientView->mutex);
+      clientView->region = viewBounds;
+      clientView->known = true;
+    }
+
+    // planet picking through the AABB tree
+    bodyTree.update(shown);
+    int64_t selected = controls.selected;
+    if (controls.pick) {
+      selected = bodyTree.pick(shown, controls.pickAt.x, controls.pickAt.y);
+    }
+    if (selected >= (int64_t)shown.size()) {
+      selected = -1;
+    }
+
+    window->clear();
+
+    // trails follow the drawn positions, so they end at the bodies
+    if (controls.clearTrails) {
+      trails.clear();
+    }
+    trails.setLength(std::max(0, controls.trailLength));
+    float unitsPerPixel = camera.getSize().x / window->getSize().x;
+    trails.update(shown, controls.trailTolerance * unitsPerPixel);
+    trails.draw(*window, viewBounds);
+
+    // only bodies whose boxes reach into the view are drawn
+    const std::vector<uint32_t> &onScreen = bodyTree.queryRegion(viewBounds);
+    bodyRenderer.draw(*window, shown, onScreen);
+
+    if (selected >= 0) {
+      float radius = shown.radius[selected];
+      sf::CircleShape outline(radius + 3.0f);
+      outline.setOrigin(radius + 3.0f, radius + 3.0f);
+      outline.setPosition(shown.x[selected], shown.y[selected]);
+      outline.setFillColor(sf::Color::Transparent);
+      outline.setOutlineColor(sf::Color::White);
+      outline.setOutlineThickness(1.0f);
+      window->draw(outline);
+    }
+
+    // nothing to draw until the UI thread has built its first frame
+    {
+      std::lock_guard<std::mutex> lock(*imguiMutex);
+      if (ImGui::GetFrameCount() > 0) {
+        ImGui::SFML::Render(*window);
+      }
+    }
+    window->display();
+    float elapsedMs = frameClock.restart().asSeconds() * 1000.0f;
+    frameMs = frameMs * 0.9f + elapsedMs * 0.1f;
+
+    std::lock_guard<std::mutex> lock(shared->mutex);
+    // written back only when changed here, so a deselect from the UI in the
+    // meantime is kept
+    if (selected != controls.selected) {
+      shared->controls.selected = selected;
+    }
+    RenderReport &report = shared->report;
+    report.planets = shown.size();
+    report.bodiesOnScreen = onScreen.size();
+    report.bodiesCulled = shown.size() - onScreen.size();
+    report.trails = trails.trailCount();
+    report.trailsOnScreen = trails.drawnCount();
+    report.sampleState = sampleState;
+    report.tickAlpha = tickAlpha;
+    report.frameMs = frameMs;
+    report.selected = selected;
+    if (selected >= 0) {
+      report.radius = shown.radius[selected];
+      report.mass = shown.mass[selected];
+      report.position = sf::Vector2f(shown.x[selected], shown.y[selected]);
+      report.velocity = sf::Vector2f(shown.vx[selected], shown.vy[selected]);
+    }
+  }
+
+  window->setActive(false);
+}
+
 int main() {
   ConnectionConfig config = showLauncher();
 
@@ -170,8 +384,6 @@ int main() {
     return 0;
   }
 
-  std::mutex planets_mutex;
-
 #if 1
   int server_sockfd = socket(AF_INET, SOCK_DGRAM, 0);
   if (server_sockfd < 0) {
@@ -189,71 +401,46 @@ int main() {
     exit(EXIT_FAILURE);
   }
 
-  struct sockaddr_in client_addr;
-  memset(&client_addr, 0, sizeof(client_addr));
-  client_addr.sin_family = AF_INET;
-  client_addr.sin_port = htons(config.port);
-  client_addr.sin_addr.s_addr = INADDR_ANY;
-
-  int opt = 1;
-  setsockopt(client_sockfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+  // the host does not listen: a bound port would take the unicast snapshots
+  // meant for a client on the same machine
+  if (config.isServer == false) {
+    struct sockaddr_in client_addr;
+    memset(&client_addr, 0, sizeof(client_addr));
+    client_addr.sin_family = AF_INET;
+    client_addr.sin_port = htons(config.port);
+    client_addr.sin_addr.s_addr = INADDR_ANY;
+
+    int opt = 1;
+    setsockopt(client_sockfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    if (bind(client_sockfd, (const struct sockaddr *)&client_addr,
+             sizeof(client_addr)) < 0) {
+      perror("client bind failed");
+      close(client_sockfd);
+      close(server_sockfd);
+      return 1;
+    }
 
-  if (bind(client_sockfd, (const struct sockaddr *)&client_addr,
-           sizeof(client_addr)) < 0) {
-    perror("client bind failed");
-    close(client_sockfd);
-    close(server_sockfd);
-    return 1;
+    struct timeval tv;
+    tv.tv_sec = 1; // 1 second timeout
+    tv.tv_usec = 0;
+    setsockopt(client_sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
   }
 
-  struct timeval tv;
-  tv.tv_sec = 1; // 1 second timeout
-  tv.tv_usec = 0;
-  setsockopt(client_sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-
   char buffer[MAXLINE];
 #endif
 
   // engine part
-  std::vector<Planet> planets;
+  BodyStore bodies;
 
   // plantet.json parsing
   if (config.isServer == true) {
-    std::ifstream planet_file("assets/planets.json", std::ifstream::binary);
-    if (!planet_file) {
+    if (!loadScene("assets/planets.json", bodies)) {
       std::cerr << "can't open planet.json";
       close(server_sockfd);
       close(client_sockfd);
       return 1;
     }
-    Json::Value planets_info;
-    planet_file >> planets_info;
-
-    const Json::Value &planets_array = planets_info["Planets"];
-
-    // Planet init
-    for (const auto &planet_data : planets_array) {
-      sf::Vector2f planetPosition, planetVelocity;
-
-      Planet p(planet_data["radius"].asFloat(), planet_data["mass"].asFloat());
-
-      planetPosition.x = planet_data["x"].asFloat();
-      planetPosition.y = planet_data["y"].asFloat();
-
-      planetVelocity.x = planet_data["velocity"][0].asFloat();
-      planetVelocity.y = planet_data["velocity"][1].asFloat();
-
-      if (planet_data.isMember("color")) {
-        p.setColor(planet_data["color"][0].asInt(),
-                   planet_data["color"][1].asInt(),
-                   planet_data["color"][2].asInt());
-      }
-
-      p.setPosition(planetPosition);
-      p.setVelocity(planetVelocity);
-
-      planets.push_back(p);
-    }
   }
 
   // window creation
@@ -262,23 +449,38 @@ int main() {
   //
   // sf::RenderWindow window(sf::VideoMode::getDesktopMode(), "cyan planet");
 
+  // paces the render thread only; the UI runs at UI_FRAME_RATE
   window.setFramerateLimit(60);
 
-  float G = 100.0f;
-  float timeStep = 0.016f;
-  std::vector<std::vector<sf::Vertex>> trajectories;
-
-  std::thread client_receive_thread(client_receive, client_sockfd, &planets,
-                                    &planets_mutex, &trajectories);
+  PhysicsSettings physics;
+  int maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+  physics.threads = maxThreads;
+  ServerSettings server;
+  TickStats tickStats;
+  ClientView clientView;
+  InterpolationBuffer interpolation;
+  TripleBuffer<PublishedState> published;
+  BodyRequests bodyRequests;
+  RenderShared render;
+  // the UI's copy, handed to the render thread after every UI frame
+  RenderControls controls;
+  controls.camera = window.getDefaultView();
+  render.controls = controls;
+
+  std::thread client_receive_thread;
   std::thread server_send_thread;
 
+  // the host renders its own simulation instead of decoding its snapshots
   if (config.isServer == true) {
-    server_send_thread =
-        std::thread(server_send_broadcast, server_sockfd, &planets,
-                    &planets_mutex, config.port, config.ip, &G, &timeStep);
+    server_send_thread = std::thread(
+        server_send_broadcast, server_sockfd, &bodies, &published,
+        &bodyRequests, config.port, config.ip, &physics, &server, &tickStats);
+  } else {
+    client_receive_thread = std::thread(client_receive, client_sockfd,
+                                        &interpolation, &clientView);
   }
 
-  sf::View camera = window.getDefaultView();
+  sf::View &camera = controls.camera;
   float cameraSpeed = 5.0f;
   int scrollBorder = 10;
 
@@ -287,12 +489,40 @@ int main() {
     return 1;
   }
 
-  while (window.isOpen()) {
+  // the render thread draws while this one handles input and builds the UI;
+  // the ImGui context is shared between them under imguiMutex
+  std::mutex imguiMutex;
+  std::atomic<bool> rendering(true);
+  window.setActive(false);
+  std::thread render_thread(
+      renderLoop, &window, &imguiMutex, &render, &rendering,
+      config.isServer ? &published : nullptr,
+      config.isServer ? nullptr : &interpolation, &clientView);
+
+  auto uiFrame = std::chrono::steady_clock::now();
+  while (rendering) {
+    RenderReport report;
+    {
+      std::lock_guard<std::mutex> lock(render.mutex);
+      report = render.report;
+    }
+    bool deselect = false;
+    std::unique_lock<std::mutex> imguiLock(imguiMutex);
+
     sf::Event event;
     while (window.pollEvent(event)) {
       ImGui::SFML::ProcessEvent(window, event);
       if (event.type == sf::Event::Closed)
-        window.close();
+        rendering = false;
+
+      // the render thread picks the planet in its next frame
+      if (event.type == sf::Event::MouseButtonPressed &&
+          event.mouseButton.button == sf::Mouse::Left &&
+          !ImGui::GetIO().WantCaptureMouse) {
+        controls.pickAt = window.mapPixelToCoords(
+            sf::Vector2i(event.mouseButton.x, event.mouseButton.y), camera);
+        controls.pick = true;
+      }
     }
     if (config.isServer == 1) {
       static sf::Clock deltaClock;
@@ -302,8 +532,91 @@ int main() {
                    ImGuiWindowFlags_AlwaysAutoResize);
 
       if (ImGui::CollapsingHeader("Physics", ImGuiTreeNodeFlags_DefaultOpen)) {
-        ImGui::SliderFloat("Gravitation", &G, 0.0f, 1000.0f, "%.1f");
-        ImGui::SliderFloat("Time step", &timeStep, 0.001f, 0.1f, "%.3f");
+        ImGui::SliderFloat("Gravitation", &physics.G, 0.0f, 1000.0f, "%.1f");
+        ImGui::SliderFloat("Time step", &physics.timeStep, 0.001f, 0.1f,
+                           "%.3f");
+        ImGui::SliderFloat("Opening angle", &physics.theta, 0.0f, 1.5f,
+                           "%.2f");
+        ImGui::InputInt("Barnes-Hut from", &physics.barnesHutThreshold, 256,
+                        1024);
+
+        if (ImGui::BeginCombo("Kernel", gravityKernelName(physics.kernel))) {
+          const GravityKernel kernels[] = {
+              GravityKernel::Auto, GravityKernel::Scalar, GravityKernel::Avx2,
+              GravityKernel::Avx512};
+          for (GravityKernel kernel : kernels) {
+            if (!gravityKernelSupported(kernel))
+              continue;
+            if (ImGui::Selectable(gravityKernelName(kernel),
+                                  physics.kernel == kernel)) {
+              physics.kernel = kernel;
+            }
+          }
+          ImGui::EndCombo();
+        }
+        if (physics.kernel == GravityKernel::Auto) {
+          ImGui::SameLine();
+          ImGui::Text("(%s)", gravityKernelName(detectGravityKernel()));
+        }
+        ImGui::SliderInt("Threads", &physics.threads, 1, maxThreads);
+
+        if (ImGui::BeginCombo("Collision",
+                              collisionBackendName(physics.collision))) {
+          const CollisionBackend backends[] = {
+              CollisionBackend::BruteForce, CollisionBackend::SpatialHash,
+              CollisionBackend::SweepAndPrune,
+              CollisionBackend::BoundingVolumeTree};
+          for (CollisionBackend backend : backends) {
+            if (ImGui::Selectable(collisionBackendName(backend),
+                                  physics.collision == backend)) {
+              physics.collision = backend;
+            }
+          }
+          ImGui::EndCombo();
+        }
+      }
+
+      if (ImGui::CollapsingHeader("Server", ImGuiTreeNodeFlags_DefaultOpen)) {
+        ImGui::SliderInt("Tick rate", &server.tickRate, 10, 500, "%d Hz");
+        ImGui::SliderInt("Substeps", &server.substeps, 1, 64);
+        ImGui::SliderInt("Send every", &server.sendInterval, 1, 16, "%d ticks");
+        ImGui::Text("Physics %d Hz, sending %.1f Hz",
+                    server.tickRate * server.substeps,
+                    (float)server.tickRate / server.sendInterval);
+        ImGui::SliderInt("Off-screen every", &server.offscreenInterval, 1, 32,
+                         "%d sends");
+
+        if (ImGui::BeginCombo("On overrun",
+                              overrunPolicyName(server.overrunPolicy))) {
+          const OverrunPolicy policies[] = {OverrunPolicy::CatchUp,
+                                            OverrunPolicy::Skip};
+          for (OverrunPolicy policy : policies) {
+            if (ImGui::Selectable(overrunPolicyName(policy),
+                                  server.overrunPolicy == policy)) {
+              server.overrunPolicy = policy;
+            }
+          }
+          ImGui::EndCombo();
+        }
+
+        const int positionBits[] = {0, 16, 24};
+        const int velocityBits[] = {0, 8, 16, 24};
+        precisionCombo("Positions", server.wire.positionBits, positionBits, 3);
+        precisionCombo("Velocities", server.wire.velocityBits, velocityBits,
+                       4);
+
+        ImGui::Text("Ticks: %llu", (unsigned long long)tickStats.ticks);
+        ImGui::Text("Overruns: %llu  skipped: %llu",
+                    (unsigned long long)tickStats.overruns,
+                    (unsigned long long)tickStats.skippedTicks);
+        // each stage has the whole tick to itself; the slowest one bounds
+        // the tick rate
+        ImGui::Text("Physics %.2f ms  publish %.2f ms  send %.2f ms",
+                    tickStats.physicsMs.load(), tickStats.publishMs.load(),
+                    tickStats.sendMs.load());
+        ImGui::Text("Tick budget %.2f ms, sends dropped: %llu",
+                    1000.0f / server.tickRate,
+                    (unsigned long long)tickStats.droppedSends);
       }
 
       ImGui::Separator();
@@ -314,7 +627,9 @@ int main() {
       }
 
       ImGui::Separator();
-      ImGui::Text("Planets: %d", (int)planets.size());
+      ImGui::Text("Planets: %d", (int)report.planets);
+      showRendering(report);
+      ImGui::Text("Tick alpha: %.2f", report.tickAlpha);
 
       static float newRadius = 10.0f;
       static float newMass = 100.0f;
@@ -348,26 +663,31 @@ int main() {
 
       ImGui::PopItemWidth();
 
+      // the simulation adds it at its next tick
       if (ImGui::Button("Create a planet")) {
-        Planet p(newRadius, newMass);
+        std::lock_guard<std::mutex> lock(bodyRequests.mutex);
+        BodyStore &added = bodyRequests.bodies;
+        Planet p(added, added.add(newRadius, newMass));
         p.setPosition(sf::Vector2f(posX, posY));
         p.setVelocity(sf::Vector2f(velX, velY));
 
         p.setColor(static_cast<int>(color[0] * 255),
                    static_cast<int>(color[1] * 255),
                    static_cast<int>(color[2] * 255));
-
-        std::lock_guard<std::mutex> lock(planets_mutex);
-        planets.push_back(p);
-        trajectories.push_back(std::vector<sf::Vertex>());
       }
 
+      deselect = showSelectedPlanet(report);
+
       ImGui::Separator();
       ImGui::Text("Trajectories");
+      // memory grows with length times the number of bodies; a higher
+      // tolerance makes the same length reach further back
+      ImGui::SliderInt("Trail length", &controls.trailLength, 0, 2000,
+                       "%d segments");
+      ImGui::SliderFloat("Trail tolerance", &controls.trailTolerance, 0.0f,
+                         4.0f, "%.2f px");
       if (ImGui::Button("Clear trajectories")) {
-        for (auto &trail : trajectories) {
-          trail.clear();
-        }
+        controls.clearTrails = true;
       }
       ImGui::End();
     } else {
@@ -383,17 +703,31 @@ int main() {
         camera = window.getDefaultView();
       }
       ImGui::Separator();
-      ImGui::Text("Planets: %d", (int)planets.size());
+      ImGui::Text("Planets: %d", (int)report.planets);
+      showRendering(report);
+      ImGui::SliderInt("Delay", &controls.interpolationDelay, 0, 500,
+                       "%d ms");
+      ImGui::Text("%s", sampleStateName(report.sampleState));
+
+      deselect = showSelectedPlanet(report);
 
       ImGui::Separator();
       ImGui::Text("Trajectories");
+      // memory grows with length times the number of bodies; a higher
+      // tolerance makes the same length reach further back
+      ImGui::SliderInt("Trail length", &controls.trailLength, 0, 2000,
+                       "%d segments");
+      ImGui::SliderFloat("Trail tolerance", &controls.trailTolerance, 0.0f,
+                         4.0f, "%.2f px");
       if (ImGui::Button("Clear trajectories")) {
-        for (auto &trail : trajectories) {
-          trail.clear();
-        }
+        controls.clearTrails = true;
       }
       ImGui::End();
     }
+    // the draw data the render thread submits until the next UI frame
+    ImGui::Render();
+    imguiLock.unlock();
+
     sf::Vector2i mousePos = sf::Mouse::getPosition(window);
     sf::Vector2u windowSize = window.getSize();
 
@@ -415,46 +749,34 @@ int main() {
       camera.move(cameraSpeed, 0);
     }
 
-    window.setView(camera);
-
-    window.clear();
-
     {
-      std::lock_guard<std::mutex> lock(planets_mutex);
-
-      if (trajectories.size() < planets.size()) {
-        for (size_t i = trajectories.size(); i < planets.size(); i++) {
-          trajectories.push_back(std::vector<sf::Vertex>());
-        }
-      } else if (trajectories.size() > planets.size()) {
-        trajectories.resize(planets.size());
+      std::lock_guard<std::mutex> lock(render.mutex);
+      RenderControls &shared = render.controls;
+      shared.camera = camera;
+      shared.trailLength = controls.trailLength;
+      shared.trailTolerance = controls.trailTolerance;
+      shared.interpolationDelay = controls.interpolationDelay;
+      // requests stay set until the render thread takes them
+      if (controls.pick) {
+        shared.pick = true;
+        shared.pickAt = controls.pickAt;
       }
-
-      for (size_t i = 0; i < planets.size(); i++) {
-        if (i < trajectories.size()) {
-          sf::Color trailColor = planets[i].getShape().getFillColor();
-          trailColor.a = 200;
-          trajectories[i].push_back(
-              sf::Vertex(planets[i].getPosition(), trailColor));
-
-          const size_t max_trajectory_points = 1000;
-          if (trajectories[i].size() > max_trajectory_points) {
-            trajectories[i].erase(trajectories[i].begin());
-          }
-
-          if (trajectories[i].size() > 1) {
-            window.draw(&trajectories[i][0], trajectories[i].size(),
-                        sf::LineStrip);
-          }
-        }
-
-        planets[i].draw(window);
+      shared.clearTrails = shared.clearTrails || controls.clearTrails;
+      if (deselect) {
+        shared.selected = -1;
       }
     }
-    ImGui::SFML::Render(window);
-    window.display();
+    controls.pick = false;
+    controls.clearTrails = false;
+
+    uiFrame += std::chrono::microseconds(1000000 / UI_FRAME_RATE);
+    uiFrame = std::max(uiFrame, std::chrono::steady_clock::now());
+    std::this_thread::sleep_until(uiFrame);
   }
+  render_thread.join();
+  window.setActive(true);
   ImGui::SFML::Shutdown();
+  window.close();
 
   // thread termination
   clientRunning = false;
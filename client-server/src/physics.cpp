@@ -1,123 +1,181 @@
 #include "physics.hpp"
-#include "engine.hpp"
-#include <SFML/System/Vector2.hpp>
-#include <X11/X.h>
-#include <arpa/inet.h>
+#include "body_store.hpp"
+#include "broad_phase.hpp"
+#include "gravity_kernels.hpp"
+#include "quadtree.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
 #include <cmath>
-#include <fcntl.h>
-#include <imgui-SFML.h>
-#include <imgui.h>
-#include <netinet/in.h>
-#include <sys/socket.h>
-#include <sys/types.h>
-#include <unistd.h>
 #include <vector>
 
-void applyGravity(std::vector<Planet> &planets, float G, float timeStep) {
-  for (int i = 0; i < planets.size(); i++) {
-    sf::Vector2f totalForce(0, 0);
+// multiple of the widest SIMD kernel so chunks keep full vectors
+static size_t gravityGrain(size_t count, size_t workers) {
+  size_t grain = count / (workers * 8) + 1;
+  return std::max<size_t>(16, (grain + 15) / 16 * 16);
+}
 
-    for (int j = 0; j < planets.size(); j++) {
-      if (i == j)
-        continue;
+// phase 1: accelerations from a read-only view of the current state, so
+// targets can be evaluated in any order, on any lane or worker
+static void computeAccelerations(const BodyStore &bodies,
+                                 const PhysicsSettings &settings,
+                                 ThreadPool &pool, float *ax, float *ay) {
+  size_t count = bodies.size();
+  size_t grain = gravityGrain(count, pool.size());
+
+  if (settings.theta > 0.0f &&
+      count >= static_cast<size_t>(settings.barnesHutThreshold)) {
+    static QuadTree tree;
+    tree.build(bodies.x.data(), bodies.y.data(), bodies.mass.data(), count);
+
+    pool.parallelFor(count, grain, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        tree.accelerationAt(i, settings.G, settings.theta, ax[i], ay[i]);
+      }
+    });
+  } else {
+    pool.parallelFor(count, grain, [&](size_t begin, size_t end) {
+      computeGravity(settings.kernel, bodies.x.data(), bodies.y.data(),
+                     bodies.mass.data(), count, settings.G, begin, end, ax,
+                     ay);
+    });
+  }
+}
 
-      sf::Vector2f direction =
-          planets[j].getPosition() - planets[i].getPosition();
+// phase 2: integrate into the back buffer and make it current
+static void integrate(BodyStore &bodies, float timeStep) {
+  size_t count = bodies.size();
+  for (size_t i = 0; i < count; i++) {
+    float vx = bodies.vx[i] + bodies.ax[i] * timeStep;
+    float vy = bodies.vy[i] + bodies.ay[i] * timeStep;
+
+    bodies.backVx[i] = vx;
+    bodies.backVy[i] = vy;
+    bodies.backX[i] = bodies.x[i] + vx * timeStep;
+    bodies.backY[i] = bodies.y[i] + vy * timeStep;
+  }
 
-      float distance =
-          std::sqrt(direction.x * direction.x + direction.y * direction.y);
+  bodies.swapBuffers();
+}
 
-      if (distance < 1.0f)
-        continue;
+void applyGravity(BodyStore &bodies, const PhysicsSettings &settings,
+                  ThreadPool &pool) {
+  computeAccelerations(bodies, settings, pool, bodies.ax.data(),
+                       bodies.ay.data());
+  integrate(bodies, settings.timeStep);
+}
 
-      direction /= distance;
+const char *collisionBackendName(CollisionBackend backend) {
+  switch (backend) {
+  case CollisionBackend::BruteForce:
+    return "Brute force";
+  case CollisionBackend::SpatialHash:
+    return "Spatial hash";
+  case CollisionBackend::SweepAndPrune:
+    return "Sweep and prune";
+  case CollisionBackend::BoundingVolumeTree:
+    return "AABB tree";
+  }
+  return "Unknown";
+}
 
-      float forceMagnitude = G * planets[i].getMass() * planets[j].getMass() /
-                             (distance * distance);
+// narrow phase: squared distances first, sqrt only for actual contacts
+static void resolveContact(BodyStore &bodies, size_t i, size_t j) {
+  const float FRICTION_COEFFICIENT = 0.08f;
 
-      totalForce += direction * forceMagnitude;
-    }
+  float collisionX = bodies.x[j] - bodies.x[i];
+  float collisionY = bodies.y[j] - bodies.y[i];
+  float distanceSq = collisionX * collisionX + collisionY * collisionY;
+  float reach = bodies.radius[i] + bodies.radius[j];
+
+  if (distanceSq >= reach * reach || distanceSq <= 0.0f)
+    return;
+
+  float distance = std::sqrt(distanceSq);
+
+  collisionX /= distance;
+  collisionY /= distance;
+
+  float m1 = bodies.mass[i], m2 = bodies.mass[j];
+  float totalMass = m1 + m2;
+  float ratio1 = m2 / totalMass;
+  float ratio2 = m1 / totalMass;
+
+  float overlap = reach - distance;
+  bodies.x[i] -= collisionX * overlap * ratio1;
+  bodies.y[i] -= collisionY * overlap * ratio1;
+  bodies.x[j] += collisionX * overlap * ratio2;
+  bodies.y[j] += collisionY * overlap * ratio2;
+
+  float v1n = bodies.vx[i] * collisionX + bodies.vy[i] * collisionY;
+  float v2n = bodies.vx[j] * collisionX + bodies.vy[j] * collisionY;
+
+  float restitution = 0.0f;
+  float u1n =
+      ((m1 - restitution * m2) * v1n + (1 + restitution) * m2 * v2n) /
+      (m1 + m2);
+  float u2n =
+      ((m2 - restitution * m1) * v2n + (1 + restitution) * m1 * v1n) /
+      (m1 + m2);
+
+  bodies.vx[i] += collisionX * (u1n - v1n);
+  bodies.vy[i] += collisionY * (u1n - v1n);
+  bodies.vx[j] += collisionX * (u2n - v2n);
+  bodies.vy[j] += collisionY * (u2n - v2n);
+
+  // friction
+  // sf::Vector2f tangent(-collisionVector.y, collisionVector.x);
+  //
+  // float v1t = v1.x * tangent.x + v1.y * tangent.y;
+  // float v2t = v2.x * tangent.x + v2.y * tangent.y;
+  //
+  // float relativeTangentialSpeed = std::abs(v1t - v2t);
+  //
+  // if (relativeTangentialSpeed > 0.1f) {
+  //   v1t *= (1.0f - FRICTION_COEFFICIENT);
+  //   v2t *= (1.0f - FRICTION_COEFFICIENT);
+  //
+  //   float new_v1n = planets[i].getVelocity().x * collisionVector.x +
+  //                   planets[i].getVelocity().y * collisionVector.y;
+  //   float new_v2n = planets[j].getVelocity().x * collisionVector.x +
+  //                   planets[j].getVelocity().y * collisionVector.y;
+  //
+  //   planets[i].setVelocity(collisionVector * new_v1n + tangent *
+  //   v1t); planets[j].setVelocity(collisionVector * new_v2n + tangent
+  //   * v2t);
+  // }
+}
 
-    sf::Vector2f newAcceleration = totalForce / planets[i].getMass();
-    planets[i].setAcceleration(newAcceleration);
+void applyCollision(BodyStore &bodies, const PhysicsSettings &settings,
+                    CollisionState &state) {
+  size_t count = bodies.size();
 
-    sf::Vector2f newVelocity =
-        planets[i].getVelocity() + newAcceleration * timeStep;
-    planets[i].setVelocity(newVelocity);
+  if (settings.collision == CollisionBackend::BruteForce) {
+    for (size_t i = 0; i < count; i++) {
+      for (size_t j = i + 1; j < count; j++) {
+        resolveContact(bodies, i, j);
+      }
+    }
+    return;
+  }
 
-    sf::Vector2f newPosition =
-        planets[i].getPosition() + newVelocity * timeStep;
-    planets[i].setPosition(newPosition);
+  state.pairs.clear();
+  if (settings.collision == CollisionBackend::SweepAndPrune) {
+    state.sweep.update(bodies);
+    state.sweep.findPairs(bodies, state.pairs);
+  } else if (settings.collision == CollisionBackend::BoundingVolumeTree) {
+    findTreePairs(state.tree, bodies, state.pairs);
+  } else {
+    state.grid.build(bodies);
+    state.grid.findPairs(bodies, state.pairs);
   }
-}
 
-void applyCollision(std::vector<Planet> &planets) {
-  const float FRICTION_COEFFICIENT = 0.08f;
-  for (int i = 0; i < planets.size(); i++) {
-    for (int j = i + 1; j < planets.size(); j++) {
-
-      if (planets[i].isColliding(planets[j])) {
-
-        sf::Vector2f collisionVector =
-            planets[j].getPosition() - planets[i].getPosition();
-        float distance = std::sqrt(collisionVector.x * collisionVector.x +
-                                   collisionVector.y * collisionVector.y);
-
-        if (distance > 0) {
-          collisionVector /= distance;
-
-          float m1 = planets[i].getMass(), m2 = planets[j].getMass();
-          float totalMass = m1 + m2;
-          float ratio1 = m2 / totalMass;
-          float ratio2 = m1 / totalMass;
-
-          float overlap =
-              (planets[i].getRadius() + planets[j].getRadius()) - distance;
-          planets[i].setPosition(planets[i].getPosition() -
-                                 collisionVector * overlap * ratio1);
-          planets[j].setPosition(planets[j].getPosition() +
-                                 collisionVector * overlap * ratio2);
-
-          sf::Vector2f v1 = planets[i].getVelocity();
-          sf::Vector2f v2 = planets[j].getVelocity();
-
-          float v1n = v1.x * collisionVector.x + v1.y * collisionVector.y;
-          float v2n = v2.x * collisionVector.x + v2.y * collisionVector.y;
-
-          float restitution = 0.0f;
-          float u1n =
-              ((m1 - restitution * m2) * v1n + (1 + restitution) * m2 * v2n) /
-              (m1 + m2);
-          float u2n =
-              ((m2 - restitution * m1) * v2n + (1 + restitution) * m1 * v1n) /
-              (m1 + m2);
-
-          planets[i].setVelocity(v1 + collisionVector * (u1n - v1n));
-          planets[j].setVelocity(v2 + collisionVector * (u2n - v2n));
-
-          // friction
-          // sf::Vector2f tangent(-collisionVector.y, collisionVector.x);
-          //
-          // float v1t = v1.x * tangent.x + v1.y * tangent.y;
-          // float v2t = v2.x * tangent.x + v2.y * tangent.y;
-          //
-          // float relativeTangentialSpeed = std::abs(v1t - v2t);
-          //
-          // if (relativeTangentialSpeed > 0.1f) {
-          //   v1t *= (1.0f - FRICTION_COEFFICIENT);
-          //   v2t *= (1.0f - FRICTION_COEFFICIENT);
-          //
-          //   float new_v1n = planets[i].getVelocity().x * collisionVector.x +
-          //                   planets[i].getVelocity().y * collisionVector.y;
-          //   float new_v2n = planets[j].getVelocity().x * collisionVector.x +
-          //                   planets[j].getVelocity().y * collisionVector.y;
-          //
-          //   planets[i].setVelocity(collisionVector * new_v1n + tangent *
-          //   v1t); planets[j].setVelocity(collisionVector * new_v2n + tangent
-          //   * v2t);
-          // }
-        }
-      }
-    }
+  // resolve in the same order as the brute-force loop
+  std::sort(state.pairs.begin(), state.pairs.end(),
+            [](const BodyPair &p, const BodyPair &q) {
+              return p.a != q.a ? p.a < q.a : p.b < q.b;
+            });
+
+  for (const BodyPair &pair : state.pairs) {
+    resolveContact(bodies, pair.a, pair.b);
   }
 }
@@ -0,0 +1,184 @@
+#include "quadtree.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+int32_t QuadTree::makeNode(float centerX, float centerY, float halfSize) {
+  Node node;
+  node.centerX = centerX;
+  node.centerY = centerY;
+  node.halfSize = halfSize;
+  node.mass = 0.0f;
+  node.massX = 0.0f;
+  node.massY = 0.0f;
+  node.firstChild = -1;
+  node.body = -1;
+  node.count = 0;
+
+  nodes.push_back(node);
+  return static_cast<int32_t>(nodes.size() - 1);
+}
+
+int32_t QuadTree::childFor(int32_t node, float px, float py) const {
+  const Node &n = nodes[node];
+  int quadrant = (px >= n.centerX ? 1 : 0) + (py >= n.centerY ? 2 : 0);
+  return n.firstChild + quadrant;
+}
+
+void QuadTree::addMass(int32_t node, int32_t body) {
+  Node &n = nodes[node];
+  n.mass += m[body];
+  n.massX += m[body] * x[body];
+  n.massY += m[body] * y[body];
+  n.count++;
+}
+
+void QuadTree::insert(int32_t body) {
+  int32_t node = 0;
+  int depth = 0;
+
+  while (true) {
+    addMass(node, body);
+
+    if (nodes[node].firstChild >= 0) {
+      node = childFor(node, x[body], y[body]);
+      depth++;
+      continue;
+    }
+
+    if (nodes[node].count == 1) {
+      nodes[node].body = body;
+      return;
+    }
+
+    // bodies closer than the deepest cell share one leaf
+    if (depth >= MAX_DEPTH) {
+      next[body] = nodes[node].body;
+      nodes[node].body = body;
+      return;
+    }
+
+    // occupied leaf: split it and push the old body one level down
+    int32_t existing = nodes[node].body;
+    float half = nodes[node].halfSize * 0.5f;
+    float cx = nodes[node].centerX;
+    float cy = nodes[node].centerY;
+
+    int32_t first = makeNode(cx - half, cy - half, half);
+    makeNode(cx + half, cy - half, half);
+    makeNode(cx - half, cy + half, half);
+    makeNode(cx + half, cy + half, half);
+
+    nodes[node].firstChild = first;
+    nodes[node].body = -1;
+    addMass(childFor(node, x[existing], y[existing]), existing);
+    nodes[childFor(node, x[existing], y[existing])].body = existing;
+
+    node = childFor(node, x[body], y[body]);
+    depth++;
+  }
+}
+
+void QuadTree::build(const float *x, const float *y, const float *mass,
+                     size_t count) {
+  this->x = x;
+  this->y = y;
+  this->m = mass;
+  nodes.clear();
+  next.assign(count, -1);
+
+  float minX = 0.0f, minY = 0.0f, maxX = 0.0f, maxY = 0.0f;
+  bool first = true;
+  for (size_t i = 0; i < count; i++) {
+    if (!std::isfinite(x[i]) || !std::isfinite(y[i]))
+      continue;
+    if (first) {
+      minX = maxX = x[i];
+      minY = maxY = y[i];
+      first = false;
+    }
+    minX = std::min(minX, x[i]);
+    maxX = std::max(maxX, x[i]);
+    minY = std::min(minY, y[i]);
+    maxY = std::max(maxY, y[i]);
+  }
+
+  float halfSize = std::max(maxX - minX, maxY - minY) * 0.5f + 1.0f;
+  makeNode((minX + maxX) * 0.5f, (minY + maxY) * 0.5f, halfSize);
+
+  for (size_t i = 0; i < count; i++) {
+    if (!std::isfinite(x[i]) || !std::isfinite(y[i]))
+      continue;
+    insert(static_cast<int32_t>(i));
+  }
+
+  for (auto &node : nodes) {
+    if (node.mass != 0.0f) {
+      node.massX /= node.mass;
+      node.massY /= node.mass;
+    } else {
+      node.massX = node.centerX;
+      node.massY = node.centerY;
+    }
+  }
+}
+
+void QuadTree::accelerationAt(size_t target, float G, float theta, float &ax,
+                              float &ay) const {
+  ax = 0.0f;
+  ay = 0.0f;
+  if (nodes.empty())
+    return;
+
+  const float px = x[target];
+  const float py = y[target];
+
+  int32_t stack[3 * MAX_DEPTH + 4];
+  int top = 0;
+  stack[top++] = 0;
+
+  auto pull = [&](float massX, float massY, float mass) {
+    float dx = massX - px;
+    float dy = massY - py;
+    float distanceSq = dx * dx + dy * dy;
+    float distance = std::sqrt(distanceSq);
+    if (distance < 1.0f)
+      return;
+
+    float scale = G * mass / (distanceSq * distance);
+    ax += dx * scale;
+    ay += dy * scale;
+  };
+
+  while (top > 0) {
+    const Node &node = nodes[stack[--top]];
+    if (node.count == 0)
+      continue;
+
+    // leaves are summed body by body, skipping the target itself
+    if (node.firstChild < 0) {
+      for (int32_t body = node.body; body >= 0; body = next[body]) {
+        if (body != static_cast<int32_t>(target)) {
+          pull(x[body], y[body], m[body]);
+        }
+      }
+      continue;
+    }
+
+    // a node around the target holds its own mass, so it is always opened
+    bool contains = std::abs(px - node.centerX) <= node.halfSize &&
+                    std::abs(py - node.centerY) <= node.halfSize;
+    float dx = node.massX - px;
+    float dy = node.massY - py;
+    float distance = std::sqrt(dx * dx + dy * dy);
+    if (!contains && 2.0f * node.halfSize < theta * distance) {
+      pull(node.massX, node.massY, node.mass);
+      continue;
+    }
+
+    for (int child = 0; child < 4; child++) {
+      stack[top++] = node.firstChild + child;
+    }
+  }
+}
@@ -0,0 +1,39 @@
+#include "scene.hpp"
+#include "body_store.hpp"
+#include "json/json.h"
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+bool loadScene(const std::string &path, BodyStore &bodies) {
+  std::ifstream planet_file(path, std::ifstream::binary);
+  if (!planet_file) {
+    return false;
+  }
+
+  Json::Value planets_info;
+  planet_file >> planets_info;
+
+  const Json::Value &planets_array = planets_info["Planets"];
+
+  // Planet init
+  for (const auto &planet_data : planets_array) {
+    size_t i = bodies.add(planet_data["radius"].asFloat(),
+                          planet_data["mass"].asFloat());
+
+    bodies.x[i] = planet_data["x"].asFloat();
+    bodies.y[i] = planet_data["y"].asFloat();
+
+    bodies.vx[i] = planet_data["velocity"][0].asFloat();
+    bodies.vy[i] = planet_data["velocity"][1].asFloat();
+
+    if (planet_data.isMember("color")) {
+      bodies.color[i] = {
+          static_cast<std::uint8_t>(planet_data["color"][0].asInt()),
+          static_cast<std::uint8_t>(planet_data["color"][1].asInt()),
+          static_cast<std::uint8_t>(planet_data["color"][2].asInt())};
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,227 @@
+#include "body_store.hpp"
+#include "client-server.hpp"
+#include "physics.hpp"
+#include "scene.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <thread>
+#include <unistd.h>
+
+// Dedicated server: simulates and broadcasts without a window, SFML
+// graphics or ImGui.
+
+struct ServerOptions {
+  int port = 8080;
+  std::string ip = "255.255.255.255";
+  std::string scene = "assets/planets.json";
+  int tickRate = 100;
+  int substeps = 1;
+  int sendInterval = 1;
+  int offscreenInterval = 8;
+  OverrunPolicy overrunPolicy = OverrunPolicy::Skip;
+  WireFormat wire;
+  int threads = std::max(1, (int)std::thread::hardware_concurrency());
+};
+
+void printUsage(const char *program) {
+  std::cout << "Usage: " << program << " [options]\n"
+            << "  -p, --port PORT       port to broadcast on (8080)\n"
+            << "  -a, --address IP      destination address "
+               "(255.255.255.255)\n"
+            << "  -s, --scene FILE      scene to load "
+               "(assets/planets.json)\n"
+            << "  -r, --tick-rate HZ    tick rate (100)\n"
+            << "  -n, --substeps N      physics steps per tick (1)\n"
+            << "  -k, --send-interval K broadcast every K ticks (1)\n"
+            << "  -i, --offscreen-interval K\n"
+            << "                        update bodies outside a client's "
+               "view every K sends (8)\n"
+            << "  -o, --overrun POLICY  catch-up or skip missed ticks "
+               "(skip)\n"
+            << "  -P, --position-bits N fixed-point positions, 16 or 24 "
+               "(floats)\n"
+            << "  -V, --velocity-bits N fixed-point velocities, 8, 16 or 24 "
+               "(floats)\n"
+            << "  -t, --threads N       gravity worker threads "
+               "(all cores)\n"
+            << "  -h, --help            show this help\n";
+}
+
+bool parseOptions(int argc, char **argv, ServerOptions &options) {
+  const option longOptions[] = {{"port", required_argument, nullptr, 'p'},
+                                {"address", required_argument, nullptr, 'a'},
+                                {"scene", required_argument, nullptr, 's'},
+                                {"tick-rate", required_argument, nullptr, 'r'},
+                                {"substeps", required_argument, nullptr, 'n'},
+                                {"send-interval", required_argument, nullptr,
+                                 'k'},
+                                {"offscreen-interval", required_argument,
+                                 nullptr, 'i'},
+                                {"overrun", required_argument, nullptr, 'o'},
+                                {"position-bits", required_argument, nullptr,
+                                 'P'},
+                                {"velocity-bits", required_argument, nullptr,
+                                 'V'},
+                                {"threads", required_argument, nullptr, 't'},
+                                {"help", no_argument, nullptr, 'h'},
+                                {nullptr, 0, nullptr, 0}};
+
+  int option;
+  while ((option = getopt_long(argc, argv, "p:a:s:r:n:k:i:o:P:V:t:h",
+                               longOptions, nullptr)) != -1) {
+    switch (option) {
+    case 'p':
+      options.port = std::atoi(optarg);
+      break;
+    case 'a':
+      options.ip = optarg;
+      break;
+    case 's':
+      options.scene = optarg;
+      break;
+    case 'r':
+      options.tickRate = std::atoi(optarg);
+      break;
+    case 'n':
+      options.substeps = std::atoi(optarg);
+      break;
+    case 'k':
+      options.sendInterval = std::atoi(optarg);
+      break;
+    case 'i':
+      options.offscreenInterval = std::atoi(optarg);
+      break;
+    case 'o':
+      if (std::strcmp(optarg, "catch-up") == 0) {
+        options.overrunPolicy = OverrunPolicy::CatchUp;
+      } else if (std::strcmp(optarg, "skip") == 0) {
+        options.overrunPolicy = OverrunPolicy::Skip;
+      } else {
+        std::cerr << "Invalid overrun policy: " << optarg << std::endl;
+        return false;
+      }
+      break;
+    case 'P':
+      options.wire.positionBits = std::atoi(optarg);
+      break;
+    case 'V':
+      options.wire.velocityBits = std::atoi(optarg);
+      break;
+    case 't':
+      options.threads = std::atoi(optarg);
+      break;
+    default:
+      return false;
+    }
+  }
+
+  if (options.port <= 0 || options.port >= 65536) {
+    std::cerr << "Invalid port: " << options.port << std::endl;
+    return false;
+  }
+  if (options.tickRate <= 0) {
+    std::cerr << "Invalid tick rate: " << options.tickRate << std::endl;
+    return false;
+  }
+  if (options.substeps <= 0) {
+    std::cerr << "Invalid substep count: " << options.substeps << std::endl;
+    return false;
+  }
+  if (options.sendInterval <= 0) {
+    std::cerr << "Invalid send interval: " << options.sendInterval
+              << std::endl;
+    return false;
+  }
+  if (options.offscreenInterval <= 0) {
+    std::cerr << "Invalid off-screen interval: " << options.offscreenInterval
+              << std::endl;
+    return false;
+  }
+  int positionBits = options.wire.positionBits;
+  if (positionBits != 0 && positionBits != 16 && positionBits != 24) {
+    std::cerr << "Invalid position bits: " << positionBits << std::endl;
+    return false;
+  }
+  int velocityBits = options.wire.velocityBits;
+  if (velocityBits != 0 && velocityBits != 8 && velocityBits != 16 &&
+      velocityBits != 24) {
+    std::cerr << "Invalid velocity bits: " << velocityBits << std::endl;
+    return false;
+  }
+  if (options.threads <= 0) {
+    std::cerr << "Invalid thread count: " << options.threads << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void stopServer(int) { clientRunning = false; }
+
+int main(int argc, char **argv) {
+  ServerOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  BodyStore bodies;
+  if (!loadScene(options.scene, bodies)) {
+    std::cerr << "can't open " << options.scene << std::endl;
+    return 1;
+  }
+
+  int server_sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (server_sockfd < 0) {
+    perror("server socket creation failed");
+    return 1;
+  }
+
+  int broadcast_enable = 1;
+  setsockopt(server_sockfd, SOL_SOCKET, SO_BROADCAST, &broadcast_enable,
+             sizeof(broadcast_enable));
+
+  std::signal(SIGINT, stopServer);
+  std::signal(SIGTERM, stopServer);
+
+  PhysicsSettings physics;
+  physics.threads = options.threads;
+
+  std::cout << "Serving " << bodies.size() << " planets from "
+            << options.scene << " to " << options.ip << ":" << options.port
+            << " at " << options.tickRate << " Hz on " << options.threads
+            << " threads, " << options.substeps << " substeps per tick, "
+            << "sending every " << options.sendInterval << " ticks"
+            << std::endl;
+
+  ServerSettings server;
+  server.tickRate = options.tickRate;
+  server.substeps = options.substeps;
+  server.sendInterval = options.sendInterval;
+  server.offscreenInterval = options.offscreenInterval;
+  server.wire = options.wire;
+  server.overrunPolicy = options.overrunPolicy;
+  TickStats tickStats;
+
+  server_send_broadcast(server_sockfd, &bodies, nullptr, nullptr, options.port,
+                        options.ip, &physics, &server, &tickStats);
+
+  std::cout << "Ran " << tickStats.ticks << " ticks, " << tickStats.overruns
+            << " overruns, " << tickStats.skippedTicks << " skipped"
+            << std::endl;
+  std::cout << "Average stage times: physics " << tickStats.physicsMs
+            << " ms, publish " << tickStats.publishMs << " ms, send "
+            << tickStats.sendMs << " ms; " << tickStats.droppedSends
+            << " sends dropped" << std::endl;
+
+  close(server_sockfd);
+  return 0;
+}
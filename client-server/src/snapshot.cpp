@@ -0,0 +1,869 @@
+#include "snapshot.hpp"
+#include "body_store.hpp"
+#include "client-server.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <netinet/in.h>
+#include <vector>
+
+// which fields of a body follow its id in a snapshot packet
+enum SnapshotField : uint8_t {
+  FIELD_X = 1 << 0,
+  FIELD_Y = 1 << 1,
+  FIELD_VX = 1 << 2,
+  FIELD_VY = 1 << 3,
+  FIELD_MASS = 1 << 4,
+  FIELD_RADIUS = 1 << 5,
+  FIELD_COLOR = 1 << 6,
+  FIELD_ALL = (1 << 7) - 1
+};
+
+// which fields are fixed-point codes in this packet
+enum SnapshotFlag : uint8_t {
+  FLAG_POSITION_CODES = 1 << 0,
+  FLAG_VELOCITY_CODES = 1 << 1
+};
+
+static const size_t MAX_PALETTE_SIZE = 256;
+// longest id varint, field mask, six 32-bit values and a palette index
+static const size_t MAX_ENTRY_SIZE = 5 + 1 + 6 * sizeof(float) + 1;
+// offset of the fragment count, patched once all fragments are written
+static const size_t COUNT_OFFSET = 1 + 2 * sizeof(uint32_t) + sizeof(uint16_t);
+// fields up to the body count: fragment count, id range, time, time scale
+static const size_t HEADER_SIZE = COUNT_OFFSET + sizeof(uint16_t) +
+                                  2 * sizeof(uint32_t) + sizeof(uint64_t) +
+                                  sizeof(float);
+
+// Per-fragment state shared by the field writers and readers.
+struct FieldEncoding {
+  WireFormat format;
+  QuantizationFrame frame;
+  BodyColor colors[MAX_PALETTE_SIZE];
+  size_t colorCount = 0;
+  size_t lastColor = 0;
+
+  // palette index of the color, added if new; the caller keeps room
+  uint8_t colorIndex(const BodyColor &color) {
+    auto same = [&](size_t k) {
+      return colors[k].r == color.r && colors[k].g == color.g &&
+             colors[k].b == color.b;
+    };
+
+    if (colorCount > 0 && same(lastColor))
+      return static_cast<uint8_t>(lastColor);
+    for (size_t k = 0; k < colorCount; k++) {
+      if (same(k)) {
+        lastColor = k;
+        return static_cast<uint8_t>(k);
+      }
+    }
+
+    colors[colorCount] = color;
+    lastColor = colorCount;
+    return static_cast<uint8_t>(colorCount++);
+  }
+};
+
+static size_t valueBytes(int bits) {
+  return bits > 0 ? static_cast<size_t>(bits) / 8 : sizeof(float);
+}
+
+static uint32_t maxCode(int bits) { return (1u << bits) - 1; }
+
+// in double, a 24-bit code does not survive float rounding
+static uint32_t quantizeValue(float value, float origin, float size,
+                              int bits) {
+  double scaled = (static_cast<double>(value) - origin) / size * maxCode(bits);
+  if (!(scaled > 0.0)) // also catches NaN
+    return 0;
+  if (scaled >= maxCode(bits))
+    return maxCode(bits);
+  return static_cast<uint32_t>(std::lround(scaled));
+}
+
+// shared by server and client, so both agree on every decoded value
+static float dequantizeValue(uint32_t code, float origin, float size,
+                             int bits) {
+  return origin + size * (static_cast<float>(code) / maxCode(bits));
+}
+
+// Keeps [origin, origin + size] while it holds [low, high] and is at most
+// four times too large. Otherwise picks a power-of-two size with a margin
+// and an origin on a quarter of it, so small drifts do not refit.
+static void fitRange(float low, float high, float &origin, float &size) {
+  if (!(low <= high)) {
+    low = high = 0.0f;
+  }
+  float extent = std::max(high - low, 1.0f);
+  if (size > 0.0f && low >= origin && high <= origin + size &&
+      size <= 4.0f * extent)
+    return;
+
+  size = std::exp2(std::ceil(std::log2(1.5f * extent)));
+  float align = size / 4.0f;
+  origin = std::floor(low / align) * align;
+}
+
+size_t Snapshot::size() const { return id.size(); }
+
+void Snapshot::resize(size_t count) {
+  id.resize(count);
+  x.resize(count);
+  y.resize(count);
+  vx.resize(count);
+  vy.resize(count);
+  mass.resize(count);
+  radius.resize(count);
+  color.resize(count);
+}
+
+void Snapshot::capture(const BodyStore &bodies, size_t count,
+                       uint32_t sequence) {
+  this->sequence = sequence;
+  format = WireFormat();
+  id.assign(bodies.id.begin(), bodies.id.begin() + count);
+  x.assign(bodies.x.begin(), bodies.x.begin() + count);
+  y.assign(bodies.y.begin(), bodies.y.begin() + count);
+  vx.assign(bodies.vx.begin(), bodies.vx.begin() + count);
+  vy.assign(bodies.vy.begin(), bodies.vy.begin() + count);
+  mass.assign(bodies.mass.begin(), bodies.mass.begin() + count);
+  radius.assign(bodies.radius.begin(), bodies.radius.begin() + count);
+  color.assign(bodies.color.begin(), bodies.color.begin() + count);
+}
+
+void Snapshot::apply(BodyStore &bodies) const {
+  size_t count = size();
+  bodies.resize(count);
+
+  for (size_t i = 0; i < count; i++) {
+    bodies.id[i] = id[i];
+    bodies.x[i] = x[i];
+    bodies.y[i] = y[i];
+    bodies.vx[i] = vx[i];
+    bodies.vy[i] = vy[i];
+    bodies.ax[i] = 0.0f;
+    bodies.ay[i] = 0.0f;
+    bodies.mass[i] = mass[i];
+    bodies.radius[i] = radius[i];
+    bodies.color[i] = color[i];
+  }
+  bodies.nextId = count > 0 ? id[count - 1] + 1 : 0;
+}
+
+void Snapshot::captureFresh(const Snapshot &current, const Snapshot &baseline,
+                            const std::vector<uint8_t> &fresh) {
+  sequence = current.sequence;
+  time = current.time;
+  timeScale = current.timeScale;
+  format = current.format;
+  frame = current.frame;
+  id = current.id;
+  x = current.x;
+  y = current.y;
+  vx = current.vx;
+  vy = current.vy;
+  mass = current.mass;
+  radius = current.radius;
+  color = current.color;
+  // codes of stale bodies are never written, their values match the baseline
+  codeX = current.codeX;
+  codeY = current.codeY;
+  codeVx = current.codeVx;
+  codeVy = current.codeVy;
+
+  size_t b = 0;
+  for (size_t i = 0; i < size(); i++) {
+    if (fresh[i])
+      continue;
+
+    while (b < baseline.size() && baseline.id[b] < id[i]) {
+      b++;
+    }
+    // bodies the baseline does not have yet are always sent
+    if (b == baseline.size() || baseline.id[b] != id[i])
+      continue;
+
+    x[i] = baseline.x[b];
+    y[i] = baseline.y[b];
+    vx[i] = baseline.vx[b];
+    vy[i] = baseline.vy[b];
+    mass[i] = baseline.mass[b];
+    radius[i] = baseline.radius[b];
+    color[i] = baseline.color[b];
+  }
+}
+
+void Snapshot::quantize(const WireFormat &format, QuantizationFrame &frame) {
+  this->format = format;
+  size_t count = size();
+  const float inf = std::numeric_limits<float>::infinity();
+
+  if (format.positionBits > 0) {
+    float minX = inf, maxX = -inf;
+    float minY = inf, maxY = -inf;
+    for (size_t i = 0; i < count; i++) {
+      if (std::isfinite(x[i]) && std::isfinite(y[i])) {
+        minX = std::min(minX, x[i]);
+        maxX = std::max(maxX, x[i]);
+        minY = std::min(minY, y[i]);
+        maxY = std::max(maxY, y[i]);
+      }
+    }
+    fitRange(minX, maxX, frame.originX, frame.sizeX);
+    fitRange(minY, maxY, frame.originY, frame.sizeY);
+
+    int bits = format.positionBits;
+    codeX.resize(count);
+    codeY.resize(count);
+    for (size_t i = 0; i < count; i++) {
+      codeX[i] = quantizeValue(x[i], frame.originX, frame.sizeX, bits);
+      codeY[i] = quantizeValue(y[i], frame.originY, frame.sizeY, bits);
+      x[i] = dequantizeValue(codeX[i], frame.originX, frame.sizeX, bits);
+      y[i] = dequantizeValue(codeY[i], frame.originY, frame.sizeY, bits);
+    }
+  }
+
+  if (format.velocityBits > 0) {
+    float minV = inf, maxV = -inf;
+    for (size_t i = 0; i < count; i++) {
+      if (std::isfinite(vx[i]) && std::isfinite(vy[i])) {
+        minV = std::min({minV, vx[i], vy[i]});
+        maxV = std::max({maxV, vx[i], vy[i]});
+      }
+    }
+    fitRange(minV, maxV, frame.originV, frame.sizeV);
+
+    int bits = format.velocityBits;
+    codeVx.resize(count);
+    codeVy.resize(count);
+    for (size_t i = 0; i < count; i++) {
+      codeVx[i] = quantizeValue(vx[i], frame.originV, frame.sizeV, bits);
+      codeVy[i] = quantizeValue(vy[i], frame.originV, frame.sizeV, bits);
+      vx[i] = dequantizeValue(codeVx[i], frame.originV, frame.sizeV, bits);
+      vy[i] = dequantizeValue(codeVy[i], frame.originV, frame.sizeV, bits);
+    }
+  }
+
+  this->frame = frame;
+}
+
+SnapshotHistory::SnapshotHistory() : slots(HISTORY_SIZE) {}
+
+Snapshot &SnapshotHistory::slot(uint32_t sequence) {
+  return slots[sequence % HISTORY_SIZE];
+}
+
+const Snapshot *SnapshotHistory::find(uint32_t sequence) const {
+  const Snapshot &snapshot = slots[sequence % HISTORY_SIZE];
+  if (sequence == 0 || snapshot.sequence != sequence)
+    return nullptr;
+  return &snapshot;
+}
+
+bool sequenceNewer(uint32_t a, uint32_t b) {
+  return static_cast<int32_t>(a - b) > 0;
+}
+
+static void putU8(std::vector<char> &buffer, uint8_t value) {
+  buffer.push_back(static_cast<char>(value));
+}
+
+static void putU16(std::vector<char> &buffer, uint16_t value) {
+  putU8(buffer, static_cast<uint8_t>(value >> 8));
+  putU8(buffer, static_cast<uint8_t>(value));
+}
+
+static void putU32(std::vector<char> &buffer, uint32_t value) {
+  uint32_t netValue = htonl(value);
+  const char *bytes = reinterpret_cast<const char *>(&netValue);
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(uint32_t));
+}
+
+static void putU64(std::vector<char> &buffer, uint64_t value) {
+  putU32(buffer, static_cast<uint32_t>(value >> 32));
+  putU32(buffer, static_cast<uint32_t>(value));
+}
+
+static void patchU32(std::vector<char> &buffer, size_t offset,
+                     uint32_t value) {
+  uint32_t netValue = htonl(value);
+  memcpy(buffer.data() + offset, &netValue, sizeof(uint32_t));
+}
+
+static void putFloat(std::vector<char> &buffer, float value) {
+  uint32_t netValue = float_to_network(value);
+  const char *bytes = reinterpret_cast<const char *>(&netValue);
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(uint32_t));
+}
+
+// big-endian fixed-point code of 1 to 3 bytes
+static void putCode(std::vector<char> &buffer, uint32_t code, size_t bytes) {
+  for (size_t k = bytes; k > 0; k--) {
+    putU8(buffer, static_cast<uint8_t>(code >> (8 * (k - 1))));
+  }
+}
+
+// LEB128, ids are written as gaps to the previous one so they stay short
+static void putVarint(std::vector<char> &buffer, uint32_t value) {
+  while (value >= 0x80) {
+    putU8(buffer, static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  putU8(buffer, static_cast<uint8_t>(value));
+}
+
+// Bounds-checked reads; past the end they return 0 and clear `ok`.
+struct PacketReader {
+  const char *data;
+  size_t size;
+  size_t offset = 0;
+  bool ok = true;
+
+  PacketReader(const char *data, size_t size) : data(data), size(size) {}
+
+  bool has(size_t bytes) {
+    if (size - offset < bytes) {
+      ok = false;
+    }
+    return ok;
+  }
+
+  uint8_t u8() {
+    if (!has(1))
+      return 0;
+    return static_cast<uint8_t>(data[offset++]);
+  }
+
+  uint16_t u16() {
+    if (!has(sizeof(uint16_t)))
+      return 0;
+    uint16_t value = static_cast<uint8_t>(data[offset]) << 8 |
+                     static_cast<uint8_t>(data[offset + 1]);
+    offset += sizeof(uint16_t);
+    return value;
+  }
+
+  uint32_t u32() {
+    if (!has(sizeof(uint32_t)))
+      return 0;
+    uint32_t value;
+    memcpy(&value, data + offset, sizeof(uint32_t));
+    offset += sizeof(uint32_t);
+    return ntohl(value);
+  }
+
+  uint64_t u64() {
+    uint64_t high = u32();
+    return high << 32 | u32();
+  }
+
+  float f32() {
+    if (!has(sizeof(uint32_t)))
+      return 0.0f;
+    uint32_t value;
+    memcpy(&value, data + offset, sizeof(uint32_t));
+    offset += sizeof(uint32_t);
+    return network_to_float(value);
+  }
+
+  uint32_t code(size_t bytes) {
+    if (!has(bytes))
+      return 0;
+    uint32_t value = 0;
+    for (size_t k = 0; k < bytes; k++) {
+      value = value << 8 | static_cast<uint8_t>(data[offset++]);
+    }
+    return value;
+  }
+
+  uint32_t varint() {
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+      uint8_t byte = u8();
+      value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return value;
+    }
+    ok = false;
+    return 0;
+  }
+
+  // advances id to the next entry of an id list with `left` entries
+  bool nextId(uint32_t &left, uint32_t &id) {
+    if (left == 0)
+      return false;
+    left--;
+    id += varint();
+    return ok;
+  }
+};
+
+// bitwise, so a NaN that stays NaN is not resent every tick
+static bool sameFloat(float a, float b) {
+  return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+static uint8_t changedFields(const Snapshot &current, size_t i,
+                             const Snapshot &baseline, size_t b) {
+  uint8_t mask = 0;
+  if (!sameFloat(current.x[i], baseline.x[b]))
+    mask |= FIELD_X;
+  if (!sameFloat(current.y[i], baseline.y[b]))
+    mask |= FIELD_Y;
+  if (!sameFloat(current.vx[i], baseline.vx[b]))
+    mask |= FIELD_VX;
+  if (!sameFloat(current.vy[i], baseline.vy[b]))
+    mask |= FIELD_VY;
+  if (!sameFloat(current.mass[i], baseline.mass[b]))
+    mask |= FIELD_MASS;
+  if (!sameFloat(current.radius[i], baseline.radius[b]))
+    mask |= FIELD_RADIUS;
+
+  const BodyColor &c = current.color[i];
+  const BodyColor &old = baseline.color[b];
+  if (c.r != old.r || c.g != old.g || c.b != old.b)
+    mask |= FIELD_COLOR;
+  return mask;
+}
+
+static void putValue(std::vector<char> &buffer, float value, uint32_t code,
+                     int bits) {
+  if (bits > 0) {
+    putCode(buffer, code, valueBytes(bits));
+  } else {
+    putFloat(buffer, value);
+  }
+}
+
+static void writeFields(std::vector<char> &buffer, const Snapshot &snapshot,
+                        size_t i, uint8_t mask, FieldEncoding &encoding) {
+  int positionBits = encoding.format.positionBits;
+  int velocityBits = encoding.format.velocityBits;
+
+  if (mask & FIELD_X)
+    putValue(buffer, snapshot.x[i], positionBits ? snapshot.codeX[i] : 0,
+             positionBits);
+  if (mask & FIELD_Y)
+    putValue(buffer, snapshot.y[i], positionBits ? snapshot.codeY[i] : 0,
+             positionBits);
+  if (mask & FIELD_VX)
+    putValue(buffer, snapshot.vx[i], velocityBits ? snapshot.codeVx[i] : 0,
+             velocityBits);
+  if (mask & FIELD_VY)
+    putValue(buffer, snapshot.vy[i], velocityBits ? snapshot.codeVy[i] : 0,
+             velocityBits);
+  if (mask & FIELD_MASS)
+    putFloat(buffer, snapshot.mass[i]);
+  if (mask & FIELD_RADIUS)
+    putFloat(buffer, snapshot.radius[i]);
+  if (mask & FIELD_COLOR)
+    putU8(buffer, encoding.colorIndex(snapshot.color[i]));
+}
+
+static float readValue(PacketReader &reader, float origin, float size,
+                       int bits) {
+  if (bits > 0)
+    return dequantizeValue(reader.code(valueBytes(bits)), origin, size, bits);
+  return reader.f32();
+}
+
+static void readFields(PacketReader &reader, Snapshot &snapshot, size_t i,
+                       uint8_t mask, const FieldEncoding &encoding) {
+  const QuantizationFrame &frame = encoding.frame;
+  int positionBits = encoding.format.positionBits;
+  int velocityBits = encoding.format.velocityBits;
+
+  if (mask & FIELD_X)
+    snapshot.x[i] =
+        readValue(reader, frame.originX, frame.sizeX, positionBits);
+  if (mask & FIELD_Y)
+    snapshot.y[i] =
+        readValue(reader, frame.originY, frame.sizeY, positionBits);
+  if (mask & FIELD_VX)
+    snapshot.vx[i] =
+        readValue(reader, frame.originV, frame.sizeV, velocityBits);
+  if (mask & FIELD_VY)
+    snapshot.vy[i] =
+        readValue(reader, frame.originV, frame.sizeV, velocityBits);
+  if (mask & FIELD_MASS)
+    snapshot.mass[i] = reader.f32();
+  if (mask & FIELD_RADIUS)
+    snapshot.radius[i] = reader.f32();
+
+  if (mask & FIELD_COLOR) {
+    uint8_t index = reader.u8();
+    if (index >= encoding.colorCount) {
+      reader.ok = false;
+      return;
+    }
+    snapshot.color[i] = encoding.colors[index];
+  }
+}
+
+// Precision flags and ranges, written after the fragment fields.
+static void writeFormat(std::vector<char> &buffer,
+                        const FieldEncoding &encoding) {
+  const WireFormat &format = encoding.format;
+  const QuantizationFrame &frame = encoding.frame;
+
+  uint8_t flags = 0;
+  if (format.positionBits > 0)
+    flags |= FLAG_POSITION_CODES;
+  if (format.velocityBits > 0)
+    flags |= FLAG_VELOCITY_CODES;
+  putU8(buffer, flags);
+
+  if (format.positionBits > 0) {
+    putU8(buffer, static_cast<uint8_t>(format.positionBits));
+    putFloat(buffer, frame.originX);
+    putFloat(buffer, frame.sizeX);
+    putFloat(buffer, frame.originY);
+    putFloat(buffer, frame.sizeY);
+  }
+  if (format.velocityBits > 0) {
+    putU8(buffer, static_cast<uint8_t>(format.velocityBits));
+    putFloat(buffer, frame.originV);
+    putFloat(buffer, frame.sizeV);
+  }
+}
+
+static bool readFormat(PacketReader &reader, FieldEncoding &encoding) {
+  WireFormat &format = encoding.format;
+  QuantizationFrame &frame = encoding.frame;
+  uint8_t flags = reader.u8();
+
+  auto validRange = [](float origin, float size) {
+    return std::isfinite(origin) && std::isfinite(size) && size > 0.0f;
+  };
+
+  if (flags & FLAG_POSITION_CODES) {
+    format.positionBits = reader.u8();
+    frame.originX = reader.f32();
+    frame.sizeX = reader.f32();
+    frame.originY = reader.f32();
+    frame.sizeY = reader.f32();
+    if (format.positionBits != 16 && format.positionBits != 24)
+      return false;
+    if (!validRange(frame.originX, frame.sizeX) ||
+        !validRange(frame.originY, frame.sizeY))
+      return false;
+  }
+  if (flags & FLAG_VELOCITY_CODES) {
+    format.velocityBits = reader.u8();
+    frame.originV = reader.f32();
+    frame.sizeV = reader.f32();
+    if (format.velocityBits != 8 && format.velocityBits != 16 &&
+        format.velocityBits != 24)
+      return false;
+    if (!validRange(frame.originV, frame.sizeV))
+      return false;
+  }
+  return reader.ok;
+}
+
+// palette at the end of the fragment, its offset sits in the header
+static bool readPalette(const char *data, size_t size,
+                        FieldEncoding &encoding, uint32_t offset) {
+  if (offset > size)
+    return false;
+
+  PacketReader reader(data, size);
+  reader.offset = offset;
+  encoding.colorCount = reader.u16();
+  if (encoding.colorCount > MAX_PALETTE_SIZE)
+    return false;
+
+  for (size_t k = 0; k < encoding.colorCount; k++) {
+    encoding.colors[k].r = reader.u8();
+    encoding.colors[k].g = reader.u8();
+    encoding.colors[k].b = reader.u8();
+  }
+  return reader.ok;
+}
+
+bool readFragmentHeader(const char *data, size_t size,
+                        FragmentHeader &header) {
+  PacketReader reader(data, size);
+  uint8_t type = reader.u8();
+  header.sequence = reader.u32();
+  header.baseline = reader.u32();
+  header.index = reader.u16();
+  header.count = reader.u16();
+  header.firstId = reader.u32();
+  header.endId = reader.u32();
+  header.time = reader.u64();
+  header.timeScale = reader.f32();
+
+  return reader.ok && type == PACKET_SNAPSHOT && header.sequence != 0 &&
+         header.index < header.count && header.firstId < header.endId;
+}
+
+void SnapshotEncoder::begin(uint32_t firstId, FieldEncoding &encoding) {
+  this->firstId = firstId;
+  previousId = firstId;
+  removed.clear();
+  entries.clear();
+  changed = 0;
+  bodyCount = 0;
+  encoding.colorCount = 0;
+  encoding.lastColor = 0;
+}
+
+bool SnapshotEncoder::fits(size_t bytes,
+                           const FieldEncoding &encoding) const {
+  // fragment fields, body count, format, palette offset, both counts
+  size_t header = HEADER_SIZE + sizeof(uint32_t) +
+                  (1 + 1 + 4 * sizeof(float) + 1 + 2 * sizeof(float)) +
+                  3 * sizeof(uint32_t);
+  size_t palette = sizeof(uint16_t) + 3 * encoding.colorCount;
+  return header + 5 * removed.size() + entries.size() + palette + bytes <=
+         FRAGMENT_SIZE;
+}
+
+void SnapshotEncoder::finish(uint32_t endId, const Snapshot &current,
+                             const Snapshot *baseline,
+                             const FieldEncoding &encoding) {
+  if (fragmentCount == fragments.size()) {
+    fragments.emplace_back();
+  }
+  std::vector<char> &buffer = fragments[fragmentCount];
+  buffer.clear();
+
+  putU8(buffer, PACKET_SNAPSHOT);
+  putU32(buffer, current.sequence);
+  putU32(buffer, baseline ? baseline->sequence : 0);
+  putU16(buffer, static_cast<uint16_t>(fragmentCount));
+  putU16(buffer, 0);
+  putU32(buffer, firstId);
+  putU32(buffer, endId);
+  putU64(buffer, current.time);
+  putFloat(buffer, current.timeScale);
+  putU32(buffer, bodyCount);
+  writeFormat(buffer, encoding);
+
+  size_t paletteOffset = buffer.size();
+  putU32(buffer, 0);
+
+  putU32(buffer, static_cast<uint32_t>(removed.size()));
+  uint32_t previous = firstId;
+  for (uint32_t id : removed) {
+    putVarint(buffer, id - previous);
+    previous = id;
+  }
+
+  putU32(buffer, changed);
+  buffer.insert(buffer.end(), entries.begin(), entries.end());
+
+  patchU32(buffer, paletteOffset, static_cast<uint32_t>(buffer.size()));
+  putU16(buffer, static_cast<uint16_t>(encoding.colorCount));
+  for (size_t k = 0; k < encoding.colorCount; k++) {
+    putU8(buffer, encoding.colors[k].r);
+    putU8(buffer, encoding.colors[k].g);
+    putU8(buffer, encoding.colors[k].b);
+  }
+
+  fragmentCount++;
+}
+
+void SnapshotEncoder::encode(const Snapshot &current,
+                             const Snapshot *baseline) {
+  size_t count = current.size();
+  size_t baselineCount = baseline ? baseline->size() : 0;
+
+  FieldEncoding encoding;
+  encoding.format = current.format;
+  encoding.frame = current.frame;
+
+  fragmentCount = 0;
+  begin(0, encoding);
+
+  // both id lists are sorted, so this is one linear merge; a fragment is
+  // closed at the id of the first item that no longer fits
+  size_t b = 0;
+  size_t i = 0;
+  while (b < baselineCount || i < count) {
+    if (b < baselineCount &&
+        (i == count || baseline->id[b] < current.id[i])) {
+      uint32_t id = baseline->id[b++];
+      if (!fits(5, encoding)) {
+        finish(id, current, baseline, encoding);
+        begin(id, encoding);
+      }
+      removed.push_back(id);
+      continue;
+    }
+
+    uint32_t id = current.id[i];
+    uint8_t mask = FIELD_ALL;
+    if (b < baselineCount && baseline->id[b] == id) {
+      mask = changedFields(current, i, *baseline, b);
+      b++;
+    }
+
+    if (mask != 0 && (!fits(MAX_ENTRY_SIZE + 3, encoding) ||
+                      encoding.colorCount == MAX_PALETTE_SIZE)) {
+      finish(id, current, baseline, encoding);
+      begin(id, encoding);
+    }
+    bodyCount++;
+
+    if (mask != 0) {
+      putVarint(entries, id - previousId);
+      previousId = id;
+      putU8(entries, mask);
+      writeFields(entries, current, i, mask, encoding);
+      changed++;
+    }
+    i++;
+  }
+  finish(UINT32_MAX, current, baseline, encoding);
+
+  for (size_t k = 0; k < fragmentCount; k++) {
+    uint16_t netCount = htons(static_cast<uint16_t>(fragmentCount));
+    memcpy(fragments[k].data() + COUNT_OFFSET, &netCount, sizeof(uint16_t));
+  }
+}
+
+size_t SnapshotEncoder::size() const { return fragmentCount; }
+
+const std::vector<char> &SnapshotEncoder::fragment(size_t index) const {
+  return fragments[index];
+}
+
+bool decodeFragment(const char *data, size_t size, const Snapshot *baseline,
+                    Snapshot &out) {
+  FragmentHeader header;
+  if (!readFragmentHeader(data, size, header))
+    return false;
+  if (header.baseline == 0) {
+    baseline = nullptr;
+  } else if (!baseline || baseline->sequence != header.baseline) {
+    return false;
+  }
+
+  out.time = header.time;
+  out.timeScale = header.timeScale;
+
+  PacketReader reader(data, size);
+  reader.offset = HEADER_SIZE;
+  uint32_t bodyCount = reader.u32();
+
+  FieldEncoding encoding;
+  if (!readFormat(reader, encoding) ||
+      !readPalette(data, size, encoding, reader.u32()))
+    return false;
+  uint32_t removedLeft = reader.u32();
+  if (!reader.ok)
+    return false;
+
+  // the baseline bodies this fragment replaces
+  size_t b = 0;
+  size_t baselineEnd = 0;
+  if (baseline) {
+    const std::vector<uint32_t> &ids = baseline->id;
+    b = std::lower_bound(ids.begin(), ids.end(), header.firstId) -
+        ids.begin();
+    baselineEnd =
+        std::lower_bound(ids.begin(), ids.end(), header.endId) - ids.begin();
+  }
+  size_t baselineCount = baselineEnd - b;
+
+  // removed ids are walked alongside the changes, so skip past them first
+  PacketReader removed = reader;
+  for (uint32_t k = 0; k < removedLeft && reader.ok; k++) {
+    reader.varint();
+  }
+  uint32_t changedLeft = reader.u32();
+  if (!reader.ok || removedLeft > baselineCount ||
+      bodyCount > baselineCount - removedLeft + changedLeft)
+    return false;
+
+  size_t count = out.size();
+  size_t end = count + bodyCount;
+  out.resize(end);
+
+  uint32_t removedId = header.firstId;
+  uint32_t changedId = header.firstId;
+  bool hasRemoved = removed.nextId(removedLeft, removedId);
+  bool hasChanged = reader.nextId(changedLeft, changedId);
+
+  while (reader.ok && removed.ok && (b < baselineEnd || hasChanged)) {
+    bool inBaseline =
+        b < baselineEnd && (!hasChanged || baseline->id[b] <= changedId);
+    bool isChanged =
+        hasChanged && (b >= baselineEnd || changedId <= baseline->id[b]);
+    uint32_t id = inBaseline ? baseline->id[b] : changedId;
+
+    if (inBaseline && !isChanged && hasRemoved && removedId == id) {
+      b++;
+      hasRemoved = removed.nextId(removedLeft, removedId);
+      continue;
+    }
+    if (count >= end || id >= header.endId ||
+        (count > 0 && id <= out.id[count - 1]))
+      return false;
+
+    out.id[count] = id;
+    if (inBaseline) {
+      out.x[count] = baseline->x[b];
+      out.y[count] = baseline->y[b];
+      out.vx[count] = baseline->vx[b];
+      out.vy[count] = baseline->vy[b];
+      out.mass[count] = baseline->mass[b];
+      out.radius[count] = baseline->radius[b];
+      out.color[count] = baseline->color[b];
+      b++;
+    }
+
+    if (isChanged) {
+      uint8_t mask = reader.u8();
+      // bodies new to the client need every field
+      if (mask > FIELD_ALL || (!inBaseline && mask != FIELD_ALL))
+        return false;
+      readFields(reader, out, count, mask, encoding);
+      hasChanged = reader.nextId(changedLeft, changedId);
+    }
+    count++;
+  }
+
+  return reader.ok && removed.ok && !hasRemoved && count == end;
+}
+
+size_t encodeAck(const Ack &ack, char *buffer) {
+  buffer[0] = static_cast<char>(PACKET_ACK);
+  uint32_t netSequence = htonl(ack.sequence);
+  memcpy(buffer + 1, &netSequence, sizeof(uint32_t));
+  if (!ack.hasView)
+    return ACK_SIZE;
+
+  const float view[] = {ack.view.minX, ack.view.minY, ack.view.maxX,
+                        ack.view.maxY};
+  for (size_t k = 0; k < 4; k++) {
+    uint32_t value = float_to_network(view[k]);
+    memcpy(buffer + ACK_SIZE + k * sizeof(uint32_t), &value, sizeof(uint32_t));
+  }
+  return MAX_ACK_SIZE;
+}
+
+bool decodeAck(const char *data, size_t size, Ack &ack) {
+  PacketReader reader(data, size);
+  if (reader.u8() != PACKET_ACK)
+    return false;
+  ack.sequence = reader.u32();
+
+  ack.hasView = size == MAX_ACK_SIZE;
+  if (ack.hasView) {
+    ack.view.minX = reader.f32();
+    ack.view.minY = reader.f32();
+    ack.view.maxX = reader.f32();
+    ack.view.maxY = reader.f32();
+    // NaN or inverted rectangles would hide everything
+    ack.hasView = ack.view.minX <= ack.view.maxX &&
+                  ack.view.minY <= ack.view.maxY;
+  }
+  return reader.ok && ack.sequence != 0;
+}
@@ -0,0 +1,177 @@
+#include "snapshot_assembler.hpp"
+#include "snapshot.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+template <typename T>
+static void replaceRange(std::vector<T> &values, size_t begin, size_t end,
+                         size_t count) {
+  values.erase(values.begin() + begin, values.begin() + end);
+  values.insert(values.begin() + begin, count, T());
+}
+
+// Replaces the bodies with ids in [firstId, endId) by the piece.
+static void spliceBodies(Snapshot &state, const Snapshot &piece,
+                         uint32_t firstId, uint32_t endId) {
+  const std::vector<uint32_t> &ids = state.id;
+  size_t begin =
+      std::lower_bound(ids.begin(), ids.end(), firstId) - ids.begin();
+  size_t end = std::lower_bound(ids.begin(), ids.end(), endId) - ids.begin();
+  size_t count = piece.size();
+
+  if (end - begin != count) {
+    replaceRange(state.id, begin, end, count);
+    replaceRange(state.x, begin, end, count);
+    replaceRange(state.y, begin, end, count);
+    replaceRange(state.vx, begin, end, count);
+    replaceRange(state.vy, begin, end, count);
+    replaceRange(state.mass, begin, end, count);
+    replaceRange(state.radius, begin, end, count);
+    replaceRange(state.color, begin, end, count);
+  }
+
+  std::copy(piece.id.begin(), piece.id.end(), state.id.begin() + begin);
+  std::copy(piece.x.begin(), piece.x.end(), state.x.begin() + begin);
+  std::copy(piece.y.begin(), piece.y.end(), state.y.begin() + begin);
+  std::copy(piece.vx.begin(), piece.vx.end(), state.vx.begin() + begin);
+  std::copy(piece.vy.begin(), piece.vy.end(), state.vy.begin() + begin);
+  std::copy(piece.mass.begin(), piece.mass.end(), state.mass.begin() + begin);
+  std::copy(piece.radius.begin(), piece.radius.end(),
+            state.radius.begin() + begin);
+  std::copy(piece.color.begin(), piece.color.end(),
+            state.color.begin() + begin);
+}
+
+SnapshotAssembler::SnapshotAssembler() : pending(MAX_PENDING) {}
+
+const Snapshot *SnapshotAssembler::add(const char *data, size_t size) {
+  FragmentHeader header;
+  if (!readFragmentHeader(data, size, header))
+    return nullptr;
+
+  Pending &snapshot = pending[header.sequence % MAX_PENDING];
+  if (snapshot.sequence != header.sequence) {
+    // a late fragment of a snapshot whose slot was already reused
+    if (snapshot.sequence != 0 &&
+        !sequenceNewer(header.sequence, snapshot.sequence))
+      return nullptr;
+
+    snapshot.sequence = header.sequence;
+    snapshot.baseline = header.baseline;
+    snapshot.count = header.count;
+    snapshot.received = 0;
+    // grown only, so fragment buffers keep their capacity between snapshots;
+    // all slots grow together, or slots that rarely get a keyframe would
+    // keep allocating long after the largest snapshot was seen
+    if (snapshot.fragments.size() < header.count) {
+      for (Pending &slot : pending) {
+        for (size_t k = slot.fragments.size(); k < header.count; k++) {
+          slot.fragments.emplace_back();
+          slot.fragments.back().reserve(SnapshotEncoder::FRAGMENT_SIZE);
+        }
+        slot.arrived.reserve(header.count);
+      }
+    }
+    snapshot.arrived.assign(header.count, false);
+    snapshot.started = std::chrono::steady_clock::now();
+  }
+
+  if (header.baseline != snapshot.baseline ||
+      header.count != snapshot.count || snapshot.arrived[header.index])
+    return nullptr;
+
+  snapshot.fragments[header.index].assign(data, data + size);
+  snapshot.arrived[header.index] = true;
+  if (++snapshot.received < snapshot.count)
+    return nullptr;
+
+  return complete(snapshot);
+}
+
+const Snapshot *SnapshotAssembler::complete(Pending &snapshot) {
+  uint32_t sequence = snapshot.sequence;
+  uint32_t baselineSequence = snapshot.baseline;
+  snapshot.sequence = 0;
+
+  const Snapshot *baseline = nullptr;
+  if (baselineSequence != 0) {
+    // the baseline must not share a history slot with the result
+    if (!sequenceNewer(sequence, baselineSequence) ||
+        sequence - baselineSequence >= SnapshotHistory::HISTORY_SIZE)
+      return nullptr;
+    baseline = history.find(baselineSequence);
+    if (!baseline)
+      return nullptr;
+  }
+
+  Snapshot &out = history.slot(sequence);
+  out.sequence = 0;
+  out.resize(0);
+
+  // fragments must tile the whole id space in order
+  uint32_t nextId = 0;
+  for (uint16_t k = 0; k < snapshot.count; k++) {
+    const std::vector<char> &fragment = snapshot.fragments[k];
+    FragmentHeader header;
+    if (!readFragmentHeader(fragment.data(), fragment.size(), header) ||
+        header.firstId != nextId)
+      return nullptr;
+    if (!decodeFragment(fragment.data(), fragment.size(), baseline, out))
+      return nullptr;
+    nextId = header.endId;
+  }
+  if (nextId != UINT32_MAX)
+    return nullptr;
+
+  // anything older can no longer be worth applying in part
+  for (Pending &other : pending) {
+    if (other.sequence != 0 && !sequenceNewer(other.sequence, sequence)) {
+      other.sequence = 0;
+    }
+  }
+
+  out.sequence = sequence;
+  return &out;
+}
+
+bool SnapshotAssembler::flushExpired(
+    std::chrono::steady_clock::duration timeout, Snapshot &state) {
+  auto now = std::chrono::steady_clock::now();
+  bool applied = false;
+
+  for (Pending &snapshot : pending) {
+    if (snapshot.sequence == 0 || now - snapshot.started < timeout)
+      continue;
+
+    uint32_t sequence = snapshot.sequence;
+    snapshot.sequence = 0;
+    if (state.sequence != 0 && !sequenceNewer(sequence, state.sequence))
+      continue;
+
+    const Snapshot *baseline = history.find(snapshot.baseline);
+    if (snapshot.baseline != 0 && !baseline)
+      continue;
+
+    for (uint16_t k = 0; k < snapshot.count; k++) {
+      if (!snapshot.arrived[k])
+        continue;
+
+      const std::vector<char> &fragment = snapshot.fragments[k];
+      FragmentHeader header;
+      readFragmentHeader(fragment.data(), fragment.size(), header);
+
+      piece.resize(0);
+      if (decodeFragment(fragment.data(), fragment.size(), baseline, piece)) {
+        spliceBodies(state, piece, header.firstId, header.endId);
+        state.time = piece.time;
+        state.timeScale = piece.timeScale;
+      }
+    }
+    state.sequence = sequence;
+    applied = true;
+  }
+  return applied;
+}
@@ -0,0 +1,129 @@
+#include "tick_scheduler.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
+
+static const int64_t NS_PER_SECOND = 1000000000;
+
+static void addNs(timespec &time, int64_t ns) {
+  int64_t total = time.tv_nsec + ns;
+  time.tv_sec += total / NS_PER_SECOND;
+  time.tv_nsec = total % NS_PER_SECOND;
+}
+
+static int64_t diffNs(const timespec &later, const timespec &earlier) {
+  return (later.tv_sec - earlier.tv_sec) * NS_PER_SECOND +
+         (later.tv_nsec - earlier.tv_nsec);
+}
+
+TickScheduler::TickScheduler(int tickRate, OverrunPolicy policy,
+                             TickStats *stats)
+    : policy(policy), stats(stats) {
+#ifdef __linux__
+  timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  if (timerfd < 0) {
+    perror("timerfd_create failed, using clock_nanosleep");
+  }
+#endif
+  setTickRate(tickRate);
+}
+
+TickScheduler::~TickScheduler() {
+  if (timerfd >= 0) {
+    close(timerfd);
+  }
+}
+
+void TickScheduler::arm() {
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  addNs(deadline, periodNs);
+
+#ifdef __linux__
+  if (timerfd >= 0) {
+    itimerspec spec;
+    spec.it_value = deadline;
+    spec.it_interval.tv_sec = periodNs / NS_PER_SECOND;
+    spec.it_interval.tv_nsec = periodNs % NS_PER_SECOND;
+    if (timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &spec, nullptr) < 0) {
+      perror("timerfd_settime failed, using clock_nanosleep");
+      close(timerfd);
+      timerfd = -1;
+    }
+  }
+#endif
+}
+
+void TickScheduler::setTickRate(int newTickRate) {
+  newTickRate = std::max(1, newTickRate);
+  if (newTickRate == tickRate)
+    return;
+
+  tickRate = newTickRate;
+  periodNs = NS_PER_SECOND / tickRate;
+  arm();
+}
+
+void TickScheduler::setPolicy(OverrunPolicy newPolicy) { policy = newPolicy; }
+
+// expirations since the last read, the kernel counts missed periods
+uint64_t TickScheduler::waitTimerfd() {
+  uint64_t expirations = 0;
+  while (read(timerfd, &expirations, sizeof(expirations)) < 0) {
+    if (errno != EINTR) {
+      perror("timerfd read failed");
+      return 1;
+    }
+  }
+  addNs(deadline, expirations * periodNs);
+  return expirations;
+}
+
+uint64_t TickScheduler::waitNanosleep() {
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) ==
+         EINTR) {
+  }
+
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  uint64_t expirations = 1 + diffNs(now, deadline) / periodNs;
+  addNs(deadline, expirations * periodNs);
+  return expirations;
+}
+
+uint64_t TickScheduler::wait() {
+  uint64_t expirations = timerfd >= 0 ? waitTimerfd() : waitNanosleep();
+  expirations = std::max<uint64_t>(1, expirations);
+
+  uint64_t run = 1;
+  if (expirations > 1) {
+    stats->overruns++;
+    run = policy == OverrunPolicy::CatchUp
+              ? std::min(expirations, MAX_CATCH_UP)
+              : 1;
+    stats->skippedTicks += expirations - run;
+  }
+
+  stats->ticks += run;
+  return run;
+}
+
+int64_t TickScheduler::tickTime() const {
+  return deadline.tv_sec * NS_PER_SECOND + deadline.tv_nsec - periodNs;
+}
+
+const char *overrunPolicyName(OverrunPolicy policy) {
+  switch (policy) {
+  case OverrunPolicy::CatchUp:
+    return "Catch up";
+  case OverrunPolicy::Skip:
+    return "Skip";
+  }
+  return "Unknown";
+}
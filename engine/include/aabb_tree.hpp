@@ -0,0 +1,96 @@
+#pragma once
+#include "body_store.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct AABB {
+  float minX, minY, maxX, maxY;
+
+  bool contains(const AABB &other) const;
+  bool overlaps(const AABB &other) const;
+  bool containsPoint(float x, float y) const;
+  float perimeter() const;
+  AABB merged(const AABB &other) const;
+};
+
+// Dynamic bounding-volume hierarchy. Leaves store a fattened box, so a
+// proxy is only reinserted once its tight box leaves the fat one, and the
+// tree is kept balanced with AVL-style rotations after every change.
+class AABBTree {
+private:
+  struct Node {
+    AABB box;
+    int32_t parent; // next free node while on the free list
+    int32_t child1, child2;
+    int32_t height; // 0 for leaves, -1 for free nodes
+    uint32_t userData;
+
+    bool isLeaf() const { return child1 < 0; }
+  };
+
+  std::vector<Node> nodes;
+  int32_t root = -1;
+  int32_t freeList = -1;
+  std::vector<int32_t> stack;
+  std::vector<int32_t> pairStack;
+
+  int32_t allocateNode();
+  void freeNode(int32_t node);
+  void insertLeaf(int32_t leaf);
+  void removeLeaf(int32_t leaf);
+  int32_t balance(int32_t node);
+  void refit(int32_t node);
+
+public:
+  int32_t createProxy(const AABB &box, float margin, uint32_t userData);
+  void destroyProxy(int32_t proxy);
+
+  // Returns true when the proxy had to be reinserted.
+  bool moveProxy(int32_t proxy, const AABB &box, float margin);
+
+  const AABB &getFatAABB(int32_t proxy) const;
+  uint32_t getUserData(int32_t proxy) const;
+  int32_t getHeight() const;
+
+  // Append the user data of every leaf whose fat box overlaps the region
+  // or contains the point.
+  void query(const AABB &region, std::vector<uint32_t> &results);
+  void queryPoint(float x, float y, std::vector<uint32_t> &results);
+
+  // Appends the user data of every two leaves whose fat boxes overlap, found
+  // by descending the tree against itself once instead of one query per
+  // leaf.
+  void findOverlaps(std::vector<BodyPair> &pairs);
+};
+
+// AABBTree kept in sync with a BodyStore, one proxy per body index.
+class BodyTree {
+private:
+  AABBTree tree;
+  std::vector<int32_t> proxies;
+  std::vector<uint32_t> results;
+  float margin;
+
+public:
+  explicit BodyTree(float margin = 4.0f);
+
+  // Moves every body's proxy; bodies added or removed since the last
+  // update get their proxies created or destroyed.
+  void update(const BodyStore &bodies);
+
+  const AABBTree &getTree() const;
+
+  // Bodies whose fat boxes overlap the region. The result is reused by the
+  // next query.
+  const std::vector<uint32_t> &queryRegion(const AABB &region);
+
+  // Index of the body under the point, or -1. Picks the smallest body when
+  // several overlap.
+  int64_t pick(const BodyStore &bodies, float x, float y);
+
+  // Body pairs whose fat boxes overlap.
+  void findOverlaps(std::vector<BodyPair> &pairs);
+};
+
+AABB bodyBounds(const BodyStore &bodies, size_t index);
@@ -0,0 +1,38 @@
+#pragma once
+#include "body_store.hpp"
+#include <SFML/Graphics.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Draws bodies of a store as one triangle list in a single draw call.
+// Circles are fans whose segment count follows their radius on screen;
+// bodies whose radius is under MIN_CIRCLE_PIXELS become a quad instead.
+class BodyRenderer {
+private:
+  std::vector<sf::Vertex> vertices;
+  sf::VertexBuffer buffer;
+  // unit circle points per segment count, built on first use
+  std::vector<std::vector<sf::Vector2f>> circles;
+
+  const std::vector<sf::Vector2f> &circle(size_t segments);
+  void addQuad(float x, float y, float half, sf::Color color);
+  void addCircle(float x, float y, float radius, size_t segments,
+                 sf::Color color);
+
+public:
+  static constexpr float MIN_CIRCLE_PIXELS = 1.0f;
+  // largest gap between a circle and its polygon, in pixels
+  static constexpr float TOLERANCE_PIXELS = 0.25f;
+  static constexpr size_t MIN_SEGMENTS = 6;
+  static constexpr size_t MAX_SEGMENTS = 128;
+
+  BodyRenderer();
+
+  // Draws the bodies at the given indices, typically those in view.
+  void draw(sf::RenderTarget &target, const BodyStore &bodies,
+            const std::vector<uint32_t> &indices);
+
+  // vertices sent by the last draw()
+  size_t vertexCount() const;
+};
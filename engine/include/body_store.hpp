@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct BodyColor {
+  std::uint8_t r, g, b;
+};
+
+struct BodyPair {
+  uint32_t a, b; // a < b
+};
+
+// Structure-of-arrays storage for every body of a scene. Physics, the UDP
+// encoder/decoder and the renderer work on the arrays directly; Planet is a
+// thin view over one index for code that wants the old object interface.
+struct BodyStore {
+  // stable across ticks and never reused; ids increase with the index
+  std::vector<uint32_t> id;
+  uint32_t nextId = 0;
+
+  std::vector<float> x, y;
+  std::vector<float> vx, vy;
+  std::vector<float> ax, ay;
+  std::vector<float> mass;
+  std::vector<float> radius;
+  std::vector<BodyColor> color;
+
+  // integration target for x, y, vx, vy; swapBuffers() makes it current
+  std::vector<float> backX, backY;
+  std::vector<float> backVx, backVy;
+
+  size_t size() const;
+  bool empty() const;
+
+  // same defaults as a new Planet: cyan, at rest, mass = radius^2 if <= 0
+  size_t add(float radius, float mass);
+
+  // bodies added by growing get fresh ids
+  void resize(size_t count);
+  void reserve(size_t count);
+  void clear();
+
+  void swapBuffers();
+};
@@ -1,17 +1,20 @@
 #pragma once
 #include "SFML/Graphics/CircleShape.hpp"
+#include "body_store.hpp"
 #include <SFML/Graphics.hpp>
 #include <SFML/System/Vector2.hpp>
 
+// View of one body in a BodyStore. Holds no state of its own, so it stays
+// valid across store reallocation as long as the index exists.
 class Planet {
 private:
-  sf::CircleShape shape;
-  float mass;
-  sf::Vector2f velocity;
-  sf::Vector2f acceleration;
+  BodyStore *store;
+  size_t index;
 
 public:
-  Planet(float radius = 10.0f, float mass = 0.0f);
+  Planet(BodyStore &store, size_t index);
+
+  size_t getIndex() const;
 
   void setColor(int red, int green, int blue);
 
@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent pool for data-parallel loops. Every worker owns a deque of
+// index ranges: it pops its own ranges from the back and steals from the
+// front of the others when it runs dry. The thread calling parallelFor
+// takes part as worker 0, so a pool of one worker never leaves that thread.
+class ThreadPool {
+private:
+  struct Range {
+    size_t begin, end;
+  };
+
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<Range> ranges;
+  };
+
+  std::vector<std::unique_ptr<WorkQueue>> queues;
+  std::vector<std::thread> threads;
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  uint64_t generation = 0;
+  bool stopping = false;
+
+  const std::function<void(size_t, size_t)> *job = nullptr;
+  std::atomic<size_t> pendingRanges{0};
+
+  bool popLocal(size_t worker, Range &range);
+  bool steal(size_t worker, Range &range);
+  void runRanges(size_t worker);
+  void workerLoop(size_t worker);
+  void start(size_t workers);
+  void stop();
+
+public:
+  explicit ThreadPool(size_t workers = 1);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // Must not be called while parallelFor is running.
+  void resize(size_t workers);
+  size_t size() const;
+
+  // Calls fn(begin, end) for chunks of at most `grain` indices covering
+  // [0, count) and returns when all of them have finished.
+  void parallelFor(size_t count, size_t grain,
+                   const std::function<void(size_t, size_t)> &fn);
+};
@@ -0,0 +1,94 @@
+#pragma once
+#include "aabb_tree.hpp"
+#include "body_store.hpp"
+#include <SFML/Graphics.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Trails of all bodies in one preallocated vertex array, drawn as lines.
+// Each body owns a lane of `length` segments used as a ring buffer, plus a
+// live segment from the last kept point to the body.
+//
+// A point is only kept once the path bends away from the live segment by
+// more than the tolerance: the directions from the last kept point that
+// pass within the tolerance of every sample since are narrowed down to a
+// wedge, and the previous sample becomes a vertex when the next one falls
+// outside it. Straight and slowly curving paths therefore cost few
+// segments, and a lane covers more history the smoother its path is.
+//
+// The rings lie one after another and are followed by the live segments of
+// all lanes, so the writes of a frame reach the GPU as one contiguous
+// update plus the few kept segments. Lanes whose bounds miss the view are
+// not drawn; the visible ones go out as a few ranges of adjacent lanes.
+class TrailRenderer {
+private:
+  struct Lane {
+    size_t head = 0;     // slot the next kept segment goes to
+    sf::Vector2f anchor; // last kept point
+    sf::Vector2f last;   // newest sample
+    // directions from the anchor, as angles relative to `reference`, that
+    // keep every sample since within the tolerance
+    float reference = 0.0f;
+    float low = 0.0f, high = 0.0f;
+    float reach = 0.0f; // farthest sample from the anchor
+    bool bounded = false;
+    // covers the kept segments; refit each time the ring wraps
+    AABB kept;
+  };
+
+  size_t length;
+  size_t laneCapacity = 0;
+  std::vector<sf::Vertex> vertices; // 2 per segment
+  std::vector<Lane> lanes;
+  std::vector<uint32_t> freeLanes;
+  // body id and lane of every trail, in id order like the bodies
+  std::vector<std::pair<uint32_t, uint32_t>> assigned, nextAssigned;
+
+  sf::VertexBuffer buffer;
+  std::vector<size_t> dirty; // segments written since the last upload
+  bool uploadAll = true;
+  std::vector<uint8_t> visible;
+  size_t drawn = 0;
+
+  size_t segmentIndex(size_t slot, uint32_t lane) const;
+  void writeSegment(size_t index, sf::Vector2f from, sf::Vector2f to,
+                    sf::Color color);
+  void clearLane(uint32_t lane);
+  uint32_t allocateLane(sf::Vector2f position);
+  void restartWedge(Lane &trail, sf::Vector2f position, float tolerance);
+  void extendLane(uint32_t lane, sf::Vector2f position, float tolerance,
+                  sf::Color color);
+  void refitLane(uint32_t lane);
+  void growLanes(size_t count);
+  void upload();
+  void drawLanes(sf::RenderTarget &target, size_t begin, size_t end);
+
+public:
+  // dirty segments this close are uploaded together with the clean ones
+  // between them
+  static constexpr size_t MERGE_GAP = 64;
+  // visible lanes are drawn in at most about this many ranges, taking
+  // hidden lanes along where needed
+  static constexpr size_t MAX_DRAWS = 64;
+
+  explicit TrailRenderer(size_t length);
+
+  // Clears all trails when the length changes.
+  void setLength(size_t newLength);
+  size_t getLength() const;
+
+  // Extends every body's trail to its current position, keeping a new
+  // vertex only where the path strays more than `tolerance` world units
+  // from a straight line; 0 keeps every sample. Trails follow body ids, so
+  // they stay with their body when others are removed.
+  void update(const BodyStore &bodies, float tolerance);
+  void clear();
+
+  // Draws the trails whose bounds overlap `view`.
+  void draw(sf::RenderTarget &target, const AABB &view);
+
+  size_t trailCount() const;
+  // trails the last draw() found in view
+  size_t drawnCount() const;
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Lock-free hand-over of whole values from one writer thread to one reader
+// thread. The writer fills back() and publishes it; the reader calls
+// update() and reads front() until its next update(). Neither side waits
+// for the other, and front() is always a value that was published whole.
+template <typename T> class TripleBuffer {
+private:
+  // set in `middle` while the value there has not been taken by the reader
+  static constexpr uint8_t FRESH = 4;
+
+  T buffers[3];
+  std::atomic<uint8_t> middle{1};
+  uint8_t backIndex = 0;  // owned by the writer
+  uint8_t frontIndex = 2; // owned by the reader
+
+public:
+  // Holds whatever the writer last got back, not its last published value.
+  T &back() { return buffers[backIndex]; }
+
+  // Hands back() to the reader, replacing a value it has not taken yet.
+  void publish() {
+    uint8_t old = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel);
+    backIndex = old & ~FRESH;
+  }
+
+  // Moves front() to the newest published value. Returns false, keeping
+  // front(), when nothing was published since the last update().
+  bool update() {
+    if (!(middle.load(std::memory_order_relaxed) & FRESH))
+      return false;
+    uint8_t old = middle.exchange(frontIndex, std::memory_order_acq_rel);
+    frontIndex = old & ~FRESH;
+    return true;
+  }
+
+  const T &front() const { return buffers[frontIndex]; }
+};
@@ -0,0 +1,377 @@
+#include "aabb_tree.hpp"
+#include "body_store.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+bool AABB::contains(const AABB &other) const {
+  return minX <= other.minX && minY <= other.minY && maxX >= other.maxX &&
+         maxY >= other.maxY;
+}
+
+bool AABB::overlaps(const AABB &other) const {
+  return minX <= other.maxX && other.minX <= maxX && minY <= other.maxY &&
+         other.minY <= maxY;
+}
+
+bool AABB::containsPoint(float x, float y) const {
+  return x >= minX && x <= maxX && y >= minY && y <= maxY;
+}
+
+float AABB::perimeter() const { return 2.0f * ((maxX - minX) + (maxY - minY)); }
+
+AABB AABB::merged(const AABB &other) const {
+  return {std::min(minX, other.minX), std::min(minY, other.minY),
+          std::max(maxX, other.maxX), std::max(maxY, other.maxY)};
+}
+
+static AABB fatten(const AABB &box, float margin) {
+  return {box.minX - margin, box.minY - margin, box.maxX + margin,
+          box.maxY + margin};
+}
+
+int32_t AABBTree::allocateNode() {
+  int32_t node;
+  if (freeList >= 0) {
+    node = freeList;
+    freeList = nodes[node].parent;
+  } else {
+    nodes.push_back(Node());
+    node = static_cast<int32_t>(nodes.size() - 1);
+  }
+
+  nodes[node].parent = -1;
+  nodes[node].child1 = -1;
+  nodes[node].child2 = -1;
+  nodes[node].height = 0;
+  nodes[node].userData = 0;
+  return node;
+}
+
+void AABBTree::freeNode(int32_t node) {
+  nodes[node].parent = freeList;
+  nodes[node].height = -1;
+  freeList = node;
+}
+
+void AABBTree::refit(int32_t node) {
+  Node &n = nodes[node];
+  const Node &child1 = nodes[n.child1];
+  const Node &child2 = nodes[n.child2];
+  n.height = 1 + std::max(child1.height, child2.height);
+  n.box = child1.box.merged(child2.box);
+}
+
+void AABBTree::insertLeaf(int32_t leaf) {
+  if (root < 0) {
+    root = leaf;
+    nodes[leaf].parent = -1;
+    return;
+  }
+
+  // descend towards the sibling with the smallest perimeter increase
+  AABB leafBox = nodes[leaf].box;
+  int32_t index = root;
+  while (!nodes[index].isLeaf()) {
+    const Node &node = nodes[index];
+    float area = node.box.perimeter();
+    float combined = node.box.merged(leafBox).perimeter();
+
+    float cost = 2.0f * combined;
+    float inheritance = 2.0f * (combined - area);
+
+    float childCost[2];
+    int32_t children[2] = {node.child1, node.child2};
+    for (int k = 0; k < 2; k++) {
+      const Node &child = nodes[children[k]];
+      float merged = child.box.merged(leafBox).perimeter();
+      float growth = child.isLeaf() ? merged : merged - child.box.perimeter();
+      childCost[k] = growth + inheritance;
+    }
+
+    if (cost < childCost[0] && cost < childCost[1])
+      break;
+
+    index = childCost[0] < childCost[1] ? children[0] : children[1];
+  }
+
+  int32_t sibling = index;
+  int32_t oldParent = nodes[sibling].parent;
+  int32_t newParent = allocateNode();
+
+  nodes[newParent].parent = oldParent;
+  nodes[newParent].box = nodes[sibling].box.merged(leafBox);
+  nodes[newParent].height = nodes[sibling].height + 1;
+  nodes[newParent].child1 = sibling;
+  nodes[newParent].child2 = leaf;
+  nodes[sibling].parent = newParent;
+  nodes[leaf].parent = newParent;
+
+  if (oldParent >= 0) {
+    if (nodes[oldParent].child1 == sibling)
+      nodes[oldParent].child1 = newParent;
+    else
+      nodes[oldParent].child2 = newParent;
+  } else {
+    root = newParent;
+  }
+
+  for (index = nodes[leaf].parent; index >= 0; index = nodes[index].parent) {
+    index = balance(index);
+    refit(index);
+  }
+}
+
+void AABBTree::removeLeaf(int32_t leaf) {
+  if (leaf == root) {
+    root = -1;
+    return;
+  }
+
+  int32_t parent = nodes[leaf].parent;
+  int32_t grandParent = nodes[parent].parent;
+  int32_t sibling = nodes[parent].child1 == leaf ? nodes[parent].child2
+                                                 : nodes[parent].child1;
+
+  if (grandParent < 0) {
+    root = sibling;
+    nodes[sibling].parent = -1;
+    freeNode(parent);
+    return;
+  }
+
+  if (nodes[grandParent].child1 == parent)
+    nodes[grandParent].child1 = sibling;
+  else
+    nodes[grandParent].child2 = sibling;
+  nodes[sibling].parent = grandParent;
+  freeNode(parent);
+
+  for (int32_t index = grandParent; index >= 0;
+       index = nodes[index].parent) {
+    index = balance(index);
+    refit(index);
+  }
+}
+
+// Rotates the taller child of `a` up when the subtrees differ in height by
+// more than one. Returns the node now at a's position.
+int32_t AABBTree::balance(int32_t a) {
+  Node &A = nodes[a];
+  if (A.isLeaf() || A.height < 2)
+    return a;
+
+  int32_t b = A.child1;
+  int32_t c = A.child2;
+  int32_t difference = nodes[c].height - nodes[b].height;
+
+  if (difference > 1 || difference < -1) {
+    // `up` replaces a, `other` stays a child of a
+    bool rotateC = difference > 1;
+    int32_t up = rotateC ? c : b;
+    int32_t other = rotateC ? b : c;
+    Node &U = nodes[up];
+    int32_t f = U.child1;
+    int32_t g = U.child2;
+
+    U.child1 = a;
+    U.parent = A.parent;
+    A.parent = up;
+
+    if (U.parent >= 0) {
+      if (nodes[U.parent].child1 == a)
+        nodes[U.parent].child1 = up;
+      else
+        nodes[U.parent].child2 = up;
+    } else {
+      root = up;
+    }
+
+    // the taller grandchild stays under `up`, the shorter moves to a
+    int32_t keep = nodes[f].height > nodes[g].height ? f : g;
+    int32_t move = keep == f ? g : f;
+
+    U.child2 = keep;
+    if (rotateC)
+      A.child2 = move;
+    else
+      A.child1 = move;
+    nodes[move].parent = a;
+
+    A.box = nodes[other].box.merged(nodes[move].box);
+    A.height = 1 + std::max(nodes[other].height, nodes[move].height);
+    U.box = A.box.merged(nodes[keep].box);
+    U.height = 1 + std::max(A.height, nodes[keep].height);
+
+    return up;
+  }
+
+  return a;
+}
+
+int32_t AABBTree::createProxy(const AABB &box, float margin,
+                              uint32_t userData) {
+  int32_t proxy = allocateNode();
+  nodes[proxy].box = fatten(box, margin);
+  nodes[proxy].userData = userData;
+  insertLeaf(proxy);
+  return proxy;
+}
+
+void AABBTree::destroyProxy(int32_t proxy) {
+  removeLeaf(proxy);
+  freeNode(proxy);
+}
+
+bool AABBTree::moveProxy(int32_t proxy, const AABB &box, float margin) {
+  if (nodes[proxy].box.contains(box))
+    return false;
+
+  removeLeaf(proxy);
+  nodes[proxy].box = fatten(box, margin);
+  insertLeaf(proxy);
+  return true;
+}
+
+const AABB &AABBTree::getFatAABB(int32_t proxy) const {
+  return nodes[proxy].box;
+}
+
+uint32_t AABBTree::getUserData(int32_t proxy) const {
+  return nodes[proxy].userData;
+}
+
+int32_t AABBTree::getHeight() const {
+  return root < 0 ? 0 : nodes[root].height;
+}
+
+void AABBTree::query(const AABB &region, std::vector<uint32_t> &results) {
+  if (root < 0)
+    return;
+
+  stack.clear();
+  stack.push_back(root);
+  while (!stack.empty()) {
+    const Node &node = nodes[stack.back()];
+    stack.pop_back();
+
+    if (!node.box.overlaps(region))
+      continue;
+
+    if (node.isLeaf()) {
+      results.push_back(node.userData);
+    } else {
+      stack.push_back(node.child1);
+      stack.push_back(node.child2);
+    }
+  }
+}
+
+void AABBTree::queryPoint(float x, float y, std::vector<uint32_t> &results) {
+  query({x, y, x, y}, results);
+}
+
+void AABBTree::findOverlaps(std::vector<BodyPair> &pairs) {
+  // every leaf pair has one lowest common ancestor, where it is found by
+  // crossing that ancestor's two subtrees
+  pairStack.clear();
+  for (size_t node = 0; node < nodes.size(); node++) {
+    if (nodes[node].height > 0) {
+      pairStack.push_back(nodes[node].child1);
+      pairStack.push_back(nodes[node].child2);
+    }
+  }
+
+  while (!pairStack.empty()) {
+    int32_t b = pairStack.back();
+    pairStack.pop_back();
+    int32_t a = pairStack.back();
+    pairStack.pop_back();
+
+    const Node &nodeA = nodes[a];
+    const Node &nodeB = nodes[b];
+    if (!nodeA.box.overlaps(nodeB.box))
+      continue;
+
+    if (nodeA.isLeaf() && nodeB.isLeaf()) {
+      uint32_t first = std::min(nodeA.userData, nodeB.userData);
+      uint32_t second = std::max(nodeA.userData, nodeB.userData);
+      pairs.push_back({first, second});
+      continue;
+    }
+
+    // split the bigger node
+    bool splitA = nodeB.isLeaf() ||
+                  (!nodeA.isLeaf() &&
+                   nodeA.box.perimeter() >= nodeB.box.perimeter());
+    if (splitA) {
+      int32_t child1 = nodeA.child1, child2 = nodeA.child2;
+      pairStack.insert(pairStack.end(), {child1, b, child2, b});
+    } else {
+      int32_t child1 = nodeB.child1, child2 = nodeB.child2;
+      pairStack.insert(pairStack.end(), {a, child1, a, child2});
+    }
+  }
+}
+
+AABB bodyBounds(const BodyStore &bodies, size_t index) {
+  float x = bodies.x[index], y = bodies.y[index], r = bodies.radius[index];
+  if (!std::isfinite(x) || !std::isfinite(y) || !std::isfinite(r))
+    return {0.0f, 0.0f, 0.0f, 0.0f};
+  return {x - r, y - r, x + r, y + r};
+}
+
+BodyTree::BodyTree(float margin) : margin(margin) {}
+
+void BodyTree::update(const BodyStore &bodies) {
+  size_t count = bodies.size();
+
+  while (proxies.size() > count) {
+    tree.destroyProxy(proxies.back());
+    proxies.pop_back();
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    AABB box = bodyBounds(bodies, i);
+    if (i < proxies.size()) {
+      tree.moveProxy(proxies[i], box, margin);
+    } else {
+      proxies.push_back(
+          tree.createProxy(box, margin, static_cast<uint32_t>(i)));
+    }
+  }
+}
+
+const AABBTree &BodyTree::getTree() const { return tree; }
+
+const std::vector<uint32_t> &BodyTree::queryRegion(const AABB &region) {
+  results.clear();
+  tree.query(region, results);
+  return results;
+}
+
+void BodyTree::findOverlaps(std::vector<BodyPair> &pairs) {
+  tree.findOverlaps(pairs);
+}
+
+int64_t BodyTree::pick(const BodyStore &bodies, float x, float y) {
+  results.clear();
+  tree.queryPoint(x, y, results);
+
+  int64_t picked = -1;
+  for (uint32_t body : results) {
+    if (body >= bodies.size())
+      continue;
+
+    float dx = bodies.x[body] - x;
+    float dy = bodies.y[body] - y;
+    float radius = bodies.radius[body];
+    if (dx * dx + dy * dy > radius * radius)
+      continue;
+
+    if (picked < 0 || radius < bodies.radius[picked])
+      picked = body;
+  }
+  return picked;
+}
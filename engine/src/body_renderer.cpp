@@ -0,0 +1,90 @@
+#include "body_renderer.hpp"
+#include "body_store.hpp"
+#include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+BodyRenderer::BodyRenderer()
+    : buffer(sf::Triangles, sf::VertexBuffer::Stream),
+      circles(MAX_SEGMENTS + 1) {}
+
+const std::vector<sf::Vector2f> &BodyRenderer::circle(size_t segments) {
+  std::vector<sf::Vector2f> &points = circles[segments];
+  if (points.empty()) {
+    const float step = 2.0f * static_cast<float>(M_PI) / segments;
+    // closed, so segment k runs from point k to k + 1
+    for (size_t k = 0; k <= segments; k++) {
+      points.emplace_back(std::cos(step * k), std::sin(step * k));
+    }
+  }
+  return points;
+}
+
+void BodyRenderer::addQuad(float x, float y, float half, sf::Color color) {
+  sf::Vector2f topLeft(x - half, y - half), topRight(x + half, y - half);
+  sf::Vector2f bottomLeft(x - half, y + half), bottomRight(x + half, y + half);
+
+  vertices.emplace_back(topLeft, color);
+  vertices.emplace_back(topRight, color);
+  vertices.emplace_back(bottomRight, color);
+  vertices.emplace_back(topLeft, color);
+  vertices.emplace_back(bottomRight, color);
+  vertices.emplace_back(bottomLeft, color);
+}
+
+void BodyRenderer::addCircle(float x, float y, float radius, size_t segments,
+                             sf::Color color) {
+  const std::vector<sf::Vector2f> &points = circle(segments);
+  sf::Vector2f center(x, y);
+
+  for (size_t k = 0; k < segments; k++) {
+    vertices.emplace_back(center, color);
+    vertices.emplace_back(center + points[k] * radius, color);
+    vertices.emplace_back(center + points[k + 1] * radius, color);
+  }
+}
+
+void BodyRenderer::draw(sf::RenderTarget &target, const BodyStore &bodies,
+                        const std::vector<uint32_t> &indices) {
+  const sf::View &view = target.getView();
+  float pixelsPerUnit = target.getSize().x * view.getViewport().width /
+                        view.getSize().x;
+
+  vertices.clear();
+  for (uint32_t i : indices) {
+    const BodyColor &body = bodies.color[i];
+    sf::Color color(body.r, body.g, body.b);
+    float radius = bodies.radius[i];
+    float pixels = radius * pixelsPerUnit;
+
+    // at least a pixel across, so nothing vanishes when zoomed out
+    if (pixels < MIN_CIRCLE_PIXELS) {
+      float half = std::max(radius, 0.5f / pixelsPerUnit);
+      addQuad(bodies.x[i], bodies.y[i], half, color);
+      continue;
+    }
+
+    // the sagitta of a segment, r (1 - cos(pi / n)), stays under tolerance
+    float angle = std::acos(std::max(0.0f, 1.0f - TOLERANCE_PIXELS / pixels));
+    size_t segments = static_cast<size_t>(std::ceil(M_PI / angle));
+    segments = std::min(std::max(segments, MIN_SEGMENTS), MAX_SEGMENTS);
+    addCircle(bodies.x[i], bodies.y[i], radius, segments, color);
+  }
+
+  if (vertices.empty())
+    return;
+
+  // grows the buffer as needed; without VBO support the array is drawn
+  // straight from memory, still in one call
+  if (sf::VertexBuffer::isAvailable() &&
+      buffer.update(vertices.data(), vertices.size(), 0)) {
+    target.draw(buffer, 0, vertices.size());
+  } else {
+    target.draw(vertices.data(), vertices.size(), sf::Triangles);
+  }
+}
+
+size_t BodyRenderer::vertexCount() const { return vertices.size(); }
@@ -0,0 +1,82 @@
+#include "body_store.hpp"
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+size_t BodyStore::size() const { return x.size(); }
+
+bool BodyStore::empty() const { return x.empty(); }
+
+size_t BodyStore::add(float radius, float mass) {
+  if (mass <= 0.0f) {
+    mass = radius * radius;
+  }
+
+  id.push_back(nextId++);
+  x.push_back(0.0f);
+  y.push_back(0.0f);
+  vx.push_back(0.0f);
+  vy.push_back(0.0f);
+  ax.push_back(0.0f);
+  ay.push_back(0.0f);
+  this->mass.push_back(mass);
+  this->radius.push_back(radius);
+  color.push_back({0, 255, 255});
+
+  backX.push_back(0.0f);
+  backY.push_back(0.0f);
+  backVx.push_back(0.0f);
+  backVy.push_back(0.0f);
+
+  return x.size() - 1;
+}
+
+void BodyStore::resize(size_t count) {
+  size_t oldCount = id.size();
+  id.resize(count);
+  for (size_t i = oldCount; i < count; i++) {
+    id[i] = nextId++;
+  }
+
+  x.resize(count);
+  y.resize(count);
+  vx.resize(count);
+  vy.resize(count);
+  ax.resize(count);
+  ay.resize(count);
+  mass.resize(count);
+  radius.resize(count);
+  color.resize(count);
+
+  backX.resize(count);
+  backY.resize(count);
+  backVx.resize(count);
+  backVy.resize(count);
+}
+
+void BodyStore::reserve(size_t count) {
+  id.reserve(count);
+  x.reserve(count);
+  y.reserve(count);
+  vx.reserve(count);
+  vy.reserve(count);
+  ax.reserve(count);
+  ay.reserve(count);
+  mass.reserve(count);
+  radius.reserve(count);
+  color.reserve(count);
+
+  backX.reserve(count);
+  backY.reserve(count);
+  backVx.reserve(count);
+  backVy.reserve(count);
+}
+
+void BodyStore::clear() { resize(0); }
+
+void BodyStore::swapBuffers() {
+  std::swap(x, backX);
+  std::swap(y, backY);
+  std::swap(vx, backVx);
+  std::swap(vy, backVy);
+}
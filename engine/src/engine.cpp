@@ -1,54 +1,61 @@
 #include "engine.hpp"
 #include "SFML/Graphics/CircleShape.hpp"
 #include "SFML/Graphics/Color.hpp"
+#include "body_store.hpp"
 #include <SFML/Graphics.hpp>
 #include <SFML/System/Vector2.hpp>
 #include <cmath>
 
-Planet::Planet(float radius, float mass) {
-  shape.setRadius(radius);
-  shape.setOrigin(radius, radius);
-  shape.setFillColor(sf::Color::Cyan);
-
-  if (mass <= 0.0f) {
-    this->mass = radius * radius;
-  } else {
-    this->mass = mass;
-  }
+Planet::Planet(BodyStore &store, size_t index) : store(&store), index(index) {}
 
-  velocity = sf::Vector2f(0, 0);
-  acceleration = sf::Vector2f(0, 0);
-}
+size_t Planet::getIndex() const { return index; }
 
 void Planet::setColor(int red, int green, int blue) {
-  shape.setFillColor(sf::Color(red, green, blue));
+  store->color[index] = {static_cast<std::uint8_t>(red),
+                         static_cast<std::uint8_t>(green),
+                         static_cast<std::uint8_t>(blue)};
 }
 
-void Planet::setRadius(float radius) {
-  shape.setRadius(radius);
-  shape.setOrigin(radius, radius);
-}
-float Planet::getRadius() const { return shape.getRadius(); }
+void Planet::setRadius(float radius) { store->radius[index] = radius; }
+float Planet::getRadius() const { return store->radius[index]; }
 
 void Planet::setPosition(sf::Vector2f planetPosition) {
-  shape.setPosition(planetPosition);
+  store->x[index] = planetPosition.x;
+  store->y[index] = planetPosition.y;
+}
+sf::Vector2f Planet::getPosition() const {
+  return sf::Vector2f(store->x[index], store->y[index]);
 }
-sf::Vector2f Planet::getPosition() const { return shape.getPosition(); }
 
 void Planet::setAcceleration(sf::Vector2f newAcceleration) {
-  this->acceleration = newAcceleration;
+  store->ax[index] = newAcceleration.x;
+  store->ay[index] = newAcceleration.y;
+}
+sf::Vector2f Planet::getAcceleration() const {
+  return sf::Vector2f(store->ax[index], store->ay[index]);
 }
-sf::Vector2f Planet::getAcceleration() const { return this->acceleration; }
 
 void Planet::setVelocity(sf::Vector2f newVelocity) {
-  this->velocity = newVelocity;
+  store->vx[index] = newVelocity.x;
+  store->vy[index] = newVelocity.y;
+}
+sf::Vector2f Planet::getVelocity() const {
+  return sf::Vector2f(store->vx[index], store->vy[index]);
 }
-sf::Vector2f Planet::getVelocity() const { return this->velocity; }
 
-void Planet::setMass(float newMass) { this->mass = newMass; }
-float Planet::getMass() const { return this->mass; }
+void Planet::setMass(float newMass) { store->mass[index] = newMass; }
+float Planet::getMass() const { return store->mass[index]; }
+
+sf::CircleShape Planet::getShape() const {
+  float radius = getRadius();
+  const BodyColor &color = store->color[index];
 
-sf::CircleShape Planet::getShape() const { return shape; }
+  sf::CircleShape shape(radius);
+  shape.setOrigin(radius, radius);
+  shape.setPosition(getPosition());
+  shape.setFillColor(sf::Color(color.r, color.g, color.b));
+  return shape;
+}
 
 bool Planet::isColliding(const Planet &other) const {
   sf::Vector2f delta = this->getPosition() - other.getPosition();
@@ -56,6 +63,9 @@ bool Planet::isColliding(const Planet &other) const {
   return distance < (this->getRadius() + other.getRadius());
 }
 
-void Planet::draw(sf::RenderWindow &window) { window.draw(shape); }
+void Planet::draw(sf::RenderWindow &window) { window.draw(getShape()); }
 
-void Planet::move(sf::Vector2f changePosition) { shape.move(changePosition); }
+void Planet::move(sf::Vector2f changePosition) {
+  store->x[index] += changePosition.x;
+  store->y[index] += changePosition.y;
+}
@@ -0,0 +1,144 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+ThreadPool::ThreadPool(size_t workers) { start(workers); }
+
+ThreadPool::~ThreadPool() { stop(); }
+
+void ThreadPool::start(size_t workers) {
+  workers = std::max<size_t>(1, workers);
+  stopping = false;
+
+  for (size_t i = 0; i < workers; i++) {
+    queues.push_back(std::make_unique<WorkQueue>());
+  }
+
+  for (size_t i = 1; i < workers; i++) {
+    threads.emplace_back(&ThreadPool::workerLoop, this, i);
+  }
+}
+
+void ThreadPool::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  threads.clear();
+  queues.clear();
+}
+
+void ThreadPool::resize(size_t workers) {
+  if (std::max<size_t>(1, workers) == size())
+    return;
+
+  stop();
+  start(workers);
+}
+
+size_t ThreadPool::size() const { return queues.size(); }
+
+bool ThreadPool::popLocal(size_t worker, Range &range) {
+  WorkQueue &queue = *queues[worker];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.ranges.empty())
+    return false;
+
+  range = queue.ranges.back();
+  queue.ranges.pop_back();
+  return true;
+}
+
+bool ThreadPool::steal(size_t worker, Range &range) {
+  for (size_t offset = 1; offset < queues.size(); offset++) {
+    WorkQueue &victim = *queues[(worker + offset) % queues.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (victim.ranges.empty())
+      continue;
+
+    range = victim.ranges.front();
+    victim.ranges.pop_front();
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::runRanges(size_t worker) {
+  Range range;
+  while (popLocal(worker, range) || steal(worker, range)) {
+    (*job)(range.begin, range.end);
+
+    if (pendingRanges.fetch_sub(1) == 1) {
+      std::lock_guard<std::mutex> lock(mutex);
+      done.notify_all();
+    }
+  }
+}
+
+void ThreadPool::workerLoop(size_t worker) {
+  uint64_t seen = 0;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&] { return stopping || generation != seen; });
+      if (stopping)
+        return;
+      seen = generation;
+    }
+
+    runRanges(worker);
+  }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grain,
+                             const std::function<void(size_t, size_t)> &fn) {
+  if (count == 0)
+    return;
+  grain = std::max<size_t>(1, grain);
+
+  if (queues.size() == 1) {
+    for (size_t begin = 0; begin < count; begin += grain) {
+      fn(begin, std::min(count, begin + grain));
+    }
+    return;
+  }
+
+  size_t chunks = (count + grain - 1) / grain;
+  job = &fn;
+  pendingRanges = chunks;
+
+  // contiguous blocks of chunks per worker, stealing evens out the rest
+  size_t workers = queues.size();
+  for (size_t worker = 0; worker < workers; worker++) {
+    size_t first = chunks * worker / workers;
+    size_t last = chunks * (worker + 1) / workers;
+
+    std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+    for (size_t chunk = first; chunk < last; chunk++) {
+      size_t begin = chunk * grain;
+      queues[worker]->ranges.push_back({begin, std::min(count, begin + grain)});
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    generation++;
+  }
+  wake.notify_all();
+
+  runRanges(0);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [&] { return pendingRanges == 0; });
+  job = nullptr;
+}
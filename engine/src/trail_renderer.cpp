@@ -0,0 +1,321 @@
+#include "trail_renderer.hpp"
+#include "aabb_tree.hpp"
+#include "body_store.hpp"
+#include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// unused segments are invisible and have no length; not built from
+// sf::Color::Transparent, which may not be initialized before this is
+static const sf::Vertex EMPTY(sf::Vector2f(0.0f, 0.0f),
+                              sf::Color(0, 0, 0, 0));
+// overlaps nothing until a point is added
+static const AABB NO_BOUNDS = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+
+static void expand(AABB &box, sf::Vector2f point) {
+  box.minX = std::min(box.minX, point.x);
+  box.minY = std::min(box.minY, point.y);
+  box.maxX = std::max(box.maxX, point.x);
+  box.maxY = std::max(box.maxY, point.y);
+}
+
+// maps an angle difference into [-pi, pi]
+static float wrapAngle(float angle) {
+  const float pi = static_cast<float>(M_PI);
+  if (angle > pi) {
+    angle -= 2.0f * pi;
+  } else if (angle < -pi) {
+    angle += 2.0f * pi;
+  }
+  return angle;
+}
+
+TrailRenderer::TrailRenderer(size_t length)
+    : length(length), buffer(sf::Lines, sf::VertexBuffer::Stream) {}
+
+// slot `length` is the live segment
+size_t TrailRenderer::segmentIndex(size_t slot, uint32_t lane) const {
+  if (slot == length)
+    return laneCapacity * length + lane;
+  return lane * length + slot;
+}
+
+void TrailRenderer::writeSegment(size_t index, sf::Vector2f from,
+                                 sf::Vector2f to, sf::Color color) {
+  vertices[2 * index] = sf::Vertex(from, color);
+  vertices[2 * index + 1] = sf::Vertex(to, color);
+  dirty.push_back(index);
+}
+
+void TrailRenderer::clearLane(uint32_t lane) {
+  for (size_t slot = 0; slot <= length; slot++) {
+    size_t index = segmentIndex(slot, lane);
+    vertices[2 * index] = EMPTY;
+    vertices[2 * index + 1] = EMPTY;
+    dirty.push_back(index);
+  }
+  lanes[lane].kept = NO_BOUNDS;
+}
+
+uint32_t TrailRenderer::allocateLane(sf::Vector2f position) {
+  if (freeLanes.empty()) {
+    growLanes(laneCapacity + 1);
+  }
+  uint32_t lane = freeLanes.back();
+  freeLanes.pop_back();
+
+  Lane &trail = lanes[lane];
+  trail.head = 0;
+  trail.kept = NO_BOUNDS;
+  trail.anchor = position;
+  trail.last = position;
+  trail.bounded = false;
+  trail.reach = 0.0f;
+  return lane;
+}
+
+void TrailRenderer::restartWedge(Lane &trail, sf::Vector2f position,
+                                 float tolerance) {
+  sf::Vector2f offset = position - trail.anchor;
+  float distance = std::hypot(offset.x, offset.y);
+  trail.reach = distance;
+  // samples within the tolerance of the anchor fit any direction
+  trail.bounded = distance > tolerance;
+  if (!trail.bounded)
+    return;
+
+  float spread = std::asin(tolerance / distance);
+  trail.reference = std::atan2(offset.y, offset.x);
+  trail.low = -spread;
+  trail.high = spread;
+}
+
+void TrailRenderer::extendLane(uint32_t lane, sf::Vector2f position,
+                               float tolerance, sf::Color color) {
+  Lane &trail = lanes[lane];
+  sf::Vector2f offset = position - trail.anchor;
+  float distance = std::hypot(offset.x, offset.y);
+
+  if (!trail.bounded) {
+    restartWedge(trail, position, tolerance);
+  } else {
+    // a sample nearer than the farthest one means the path turned back
+    bool strays = distance < trail.reach - tolerance;
+    float relative = 0.0f;
+    if (distance > tolerance) {
+      relative = wrapAngle(std::atan2(offset.y, offset.x) - trail.reference);
+      strays = strays || relative < trail.low || relative > trail.high;
+    }
+
+    if (strays) {
+      // keep the previous sample and start over from it
+      writeSegment(segmentIndex(trail.head, lane), trail.anchor, trail.last,
+                   color);
+      expand(trail.kept, trail.anchor);
+      expand(trail.kept, trail.last);
+      trail.head = (trail.head + 1) % length;
+      if (trail.head == 0) {
+        refitLane(lane);
+      }
+      trail.anchor = trail.last;
+      restartWedge(trail, position, tolerance);
+    } else if (distance > tolerance) {
+      float spread = std::asin(tolerance / distance);
+      trail.low = std::max(trail.low, relative - spread);
+      trail.high = std::min(trail.high, relative + spread);
+      trail.reach = std::max(trail.reach, distance);
+    }
+  }
+
+  trail.last = position;
+  writeSegment(segmentIndex(length, lane), trail.anchor, position, color);
+}
+
+// drops the segments the ring has overwritten since the last refit
+void TrailRenderer::refitLane(uint32_t lane) {
+  Lane &trail = lanes[lane];
+  trail.kept = NO_BOUNDS;
+  for (size_t slot = 0; slot < length; slot++) {
+    size_t index = segmentIndex(slot, lane);
+    if (vertices[2 * index].color.a == 0)
+      continue;
+    expand(trail.kept, vertices[2 * index].position);
+    expand(trail.kept, vertices[2 * index + 1].position);
+  }
+}
+
+void TrailRenderer::growLanes(size_t count) {
+  size_t capacity = std::max(count, laneCapacity * 2);
+  // the rings keep their place, the live segments move behind the new ones
+  std::vector<sf::Vertex> grown((length + 1) * capacity * 2, EMPTY);
+  size_t rings = laneCapacity * length * 2;
+  std::copy(vertices.begin(), vertices.begin() + rings, grown.begin());
+  std::copy(vertices.begin() + rings, vertices.end(),
+            grown.begin() + capacity * length * 2);
+  vertices.swap(grown);
+
+  lanes.resize(capacity);
+  // the lowest new lane is handed out first
+  for (size_t lane = capacity; lane-- > laneCapacity;) {
+    freeLanes.push_back(static_cast<uint32_t>(lane));
+  }
+  laneCapacity = capacity;
+
+  dirty.clear();
+  uploadAll = true;
+}
+
+void TrailRenderer::setLength(size_t newLength) {
+  if (newLength == length)
+    return;
+
+  length = newLength;
+  laneCapacity = 0;
+  std::vector<sf::Vertex>().swap(vertices);
+  lanes.clear();
+  freeLanes.clear();
+  assigned.clear();
+  dirty.clear();
+  uploadAll = true;
+}
+
+size_t TrailRenderer::getLength() const { return length; }
+
+void TrailRenderer::update(const BodyStore &bodies, float tolerance) {
+  if (length == 0)
+    return;
+  if (bodies.size() > laneCapacity) {
+    growLanes(bodies.size());
+  }
+
+  // both lists are sorted by id, so one pass pairs bodies with their lanes
+  nextAssigned.clear();
+  size_t k = 0;
+  for (size_t i = 0; i < bodies.size(); i++) {
+    uint32_t id = bodies.id[i];
+    while (k < assigned.size() && assigned[k].first < id) {
+      clearLane(assigned[k].second);
+      freeLanes.push_back(assigned[k].second);
+      k++;
+    }
+
+    sf::Vector2f position(bodies.x[i], bodies.y[i]);
+    if (k == assigned.size() || assigned[k].first != id) {
+      nextAssigned.emplace_back(id, allocateLane(position));
+      continue;
+    }
+
+    uint32_t lane = assigned[k++].second;
+    const BodyColor &color = bodies.color[i];
+    extendLane(lane, position, tolerance,
+               sf::Color(color.r, color.g, color.b, 200));
+    nextAssigned.emplace_back(id, lane);
+  }
+  for (; k < assigned.size(); k++) {
+    clearLane(assigned[k].second);
+    freeLanes.push_back(assigned[k].second);
+  }
+
+  assigned.swap(nextAssigned);
+}
+
+void TrailRenderer::clear() {
+  std::fill(vertices.begin(), vertices.end(), EMPTY);
+  freeLanes.clear();
+  for (size_t lane = laneCapacity; lane-- > 0;) {
+    freeLanes.push_back(static_cast<uint32_t>(lane));
+  }
+  assigned.clear();
+  dirty.clear();
+  uploadAll = true;
+}
+
+void TrailRenderer::upload() {
+  if (uploadAll) {
+    if (buffer.getVertexCount() != vertices.size()) {
+      buffer.create(vertices.size());
+    }
+    buffer.update(vertices.data());
+    uploadAll = false;
+    dirty.clear();
+    return;
+  }
+
+  std::sort(dirty.begin(), dirty.end());
+  size_t k = 0;
+  while (k < dirty.size()) {
+    size_t begin = dirty[k];
+    size_t end = begin + 1;
+    for (k++; k < dirty.size() && dirty[k] <= end + MERGE_GAP; k++) {
+      end = std::max(end, dirty[k] + 1);
+    }
+    buffer.update(vertices.data() + 2 * begin, 2 * (end - begin),
+                  static_cast<unsigned int>(2 * begin));
+  }
+  dirty.clear();
+}
+
+void TrailRenderer::drawLanes(sf::RenderTarget &target, size_t begin,
+                              size_t end) {
+  size_t ring = 2 * begin * length, ringCount = 2 * (end - begin) * length;
+  size_t live = 2 * segmentIndex(length, static_cast<uint32_t>(begin));
+  size_t liveCount = 2 * (end - begin);
+
+  if (sf::VertexBuffer::isAvailable()) {
+    target.draw(buffer, ring, ringCount);
+    target.draw(buffer, live, liveCount);
+  } else {
+    target.draw(vertices.data() + ring, ringCount, sf::Lines);
+    target.draw(vertices.data() + live, liveCount, sf::Lines);
+  }
+}
+
+void TrailRenderer::draw(sf::RenderTarget &target, const AABB &view) {
+  drawn = 0;
+  if (vertices.empty())
+    return;
+
+  visible.assign(laneCapacity, 0);
+  for (const auto &trail : assigned) {
+    const Lane &lane = lanes[trail.second];
+    AABB live = NO_BOUNDS;
+    expand(live, lane.anchor);
+    expand(live, lane.last);
+    if (lane.kept.overlaps(view) || live.overlaps(view)) {
+      visible[trail.second] = 1;
+      drawn++;
+    }
+  }
+
+  if (sf::VertexBuffer::isAvailable()) {
+    upload();
+  } else {
+    dirty.clear();
+  }
+
+  // hidden lanes in gaps this short are drawn too, which bounds the calls
+  size_t gap = std::max<size_t>(1, laneCapacity / MAX_DRAWS);
+  size_t lane = 0;
+  while (lane < laneCapacity) {
+    if (!visible[lane]) {
+      lane++;
+      continue;
+    }
+
+    size_t begin = lane, end = lane + 1;
+    for (lane++; lane < laneCapacity && lane - end < gap; lane++) {
+      if (visible[lane]) {
+        end = lane + 1;
+      }
+    }
+    drawLanes(target, begin, end);
+  }
+}
+
+size_t TrailRenderer::trailCount() const { return assigned.size(); }
+
+size_t TrailRenderer::drawnCount() const { return drawn; }